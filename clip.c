@@ -0,0 +1,117 @@
+#include <u.h>
+#include <libc.h>
+#include <thread.h>
+#include <draw.h>
+#include <memdraw.h>
+#include <mouse.h>
+#include <keyboard.h>
+#include <geometry.h>
+#include "libobj/obj.h"
+#include "dat.h"
+#include "fns.h"
+
+/*
+ * clipping happens in homogeneous screen space, right out of the
+ * vertex shader. w grows linearly with the distance to the camera,
+ * being 0 at it and 1 at the center of the view.
+ */
+#define NEARW	0.01
+#define FARW	1000.0
+
+enum {
+	CPNear,
+	CPFar,
+	CPLeft,
+	CPRight,
+	CPTop,
+	CPBottom,
+};
+
+/*
+ * signed distance to a plane, positive inside. the guard band
+ * keeps x and y well within int range, so the bboxes can be
+ * computed, and small enough for the edge functions to keep
+ * their precision.
+ */
+static double
+planedist(Point3 p, int plane, Rectangle r)
+{
+	switch(plane){
+	case CPNear: return p.w - NEARW;
+	case CPFar: return FARW - p.w;
+	case CPLeft: return p.x - (double)(r.min.x - GUARDBAND)*p.w;
+	case CPRight: return (double)(r.max.x + GUARDBAND)*p.w - p.x;
+	case CPTop: return p.y - (double)(r.min.y - GUARDBAND)*p.w;
+	case CPBottom: return (double)(r.max.y + GUARDBAND)*p.w - p.y;
+	}
+	return 0;
+}
+
+/*
+ * one bit per plane the point is outside of.
+ */
+int
+clipcode(Point3 p, Rectangle r)
+{
+	int i, c;
+
+	c = 0;
+	for(i = 0; i < NCLIPPLANES; i++)
+		if(planedist(p, i, r) < 0)
+			c |= 1<<i;
+	return c;
+}
+
+static Point3
+lerppt3(Point3 a, Point3 b, double t)
+{
+	return Pt3(flerp(a.x, b.x, t), flerp(a.y, b.y, t), flerp(a.z, b.z, t), flerp(a.w, b.w, t));
+}
+
+static void
+lerpvertex(Vertex *v, Vertex *a, Vertex *b, double t)
+{
+	v->p = lerppt3(a->p, b->p, t);
+	v->n = lerppt3(a->n, b->n, t);
+	v->uv = Pt2(flerp(a->uv.x, b->uv.x, t), flerp(a->uv.y, b->uv.y, t), flerp(a->uv.w, b->uv.w, t));
+	v->intensity = flerp(a->intensity, b->intensity, t);
+}
+
+/*
+ * clip a triangle against the planes in code, the union of its
+ * vertices' clip codes (Sutherland-Hodgman). the resulting convex
+ * polygon goes into poly, which must fit MAXCLIPVERTS, and its
+ * number of vertices is returned—0 if nothing is left.
+ */
+int
+cliptriangle(Vertex *poly, Vertex **tri, int code, Rectangle r)
+{
+	Vertex buf[2][MAXCLIPVERTS], *in, *out;
+	double d0, d1;
+	int i, j, n, m, p;
+
+	in = buf[0];
+	for(n = 0; n < 3; n++)
+		in[n] = *tri[n];
+	for(p = 0; p < NCLIPPLANES; p++){
+		if((code & 1<<p) == 0)
+			continue;
+		out = in == buf[0]? buf[1]: buf[0];
+		m = 0;
+		for(i = 0; i < n; i++){
+			j = i+1 == n? 0: i+1;
+			d0 = planedist(in[i].p, p, r);
+			d1 = planedist(in[j].p, p, r);
+			if(d0 >= 0)
+				out[m++] = in[i];
+			if((d0 >= 0) != (d1 >= 0))
+				lerpvertex(&out[m++], &in[i], &in[j], d0/(d0 - d1));
+		}
+		in = out;
+		n = m;
+		if(n < 3)
+			return 0;
+	}
+	memmove(poly, in, n*sizeof(*poly));
+	return n;
+}
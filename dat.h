@@ -1,4 +1,71 @@
+enum {
+	TILESIZE = 32,	/* side of a screen tile, in pixels */
+	BATCHSIZE = 32,	/* triangles grabbed at a time by a shader unit */
+	HIZSIZE = 8,	/* side of a hierarchical-z block, in pixels */
+	HIZPERTILE = TILESIZE/HIZSIZE,	/* blocks per tile side; a tile's fit in a ulong mask */
+	TEXBLK = 4,	/* side of a texel block, 64 bytes */
+	GUARDBAND = 1<<20,	/* pixels past the fb before x and y get clipped */
+	NCLIPPLANES = 6,	/* near, far and the guard band's four sides */
+	MAXCLIPVERTS = 3+NCLIPPLANES,	/* a triangle clipped by every plane */
+	ZD24MAX = 0xFFFFFF,	/* nearest ZD24 depth */
+	NJOBSLOTS = 2,	/* frames in flight through the shader units */
+	NSTATBUCKETS = 40,	/* log₂ histogram buckets, up to ~9 minutes in ns */
+};
+
+/* depth buffer formats */
+enum {
+	ZFloat,		/* float, cleared to -∞ */
+	ZD24,		/* 24-bit fixed point in a u32int, cleared to 0 */
+};
+
+/* depth in [0,1] to ZD24, rounded so it decodes back to itself */
+#define ZD24(d)	(1 + (u32int)((d)*(ZD24MAX-1) + 0.5))
+/* and back; a clear pixel is -∞ */
+#define ZD24F(q)	((q) == 0? Inf(-1): (double)((q)-1)/(ZD24MAX-1))
+
+/* face culling modes. front faces wind clockwise on screen */
+enum {
+	CullNone,
+	CullBack,
+	CullFront,
+};
+
+/* debug overlays */
+enum {
+	OWireframe	= 1<<0,
+	ONormals	= 1<<1,
+	OBBoxes		= 1<<2,
+};
+
+/* texture filters */
+enum {
+	TNearest,
+	TBilinear,
+	TTrilinear,	/* bilinear, blended between mip levels */
+};
+
+/* texture address modes */
+enum {
+	TWrap,
+	TClamp,
+};
+
+/* texture memory layouts */
+enum {
+	TLinear,	/* row-major */
+	TBlocked,	/* row-major TEXBLKxTEXBLK blocks of row-major texels */
+};
+
 typedef Point Triangle[3];
+typedef struct Vertex Vertex;
+typedef struct Mesh Mesh;
+typedef struct Texlevel Texlevel;
+typedef struct Texture Texture;
+typedef struct Primitive Primitive;
+typedef struct Bin Bin;
+typedef struct Binset Binset;
+typedef struct Job Job;
+typedef struct Zrange Zrange;
 typedef struct VSparams VSparams;
 typedef struct FSparams FSparams;
 typedef struct SUparams SUparams;
@@ -6,70 +73,214 @@ typedef struct Shader Shader;
 typedef struct Framebuf Framebuf;
 typedef struct Framebufctl Framebufctl;
 
+/* a vertex along with its varyings */
+struct Vertex
+{
+	Point3 p;			/* position */
+	Point3 n;			/* normal */
+	Point2 uv;			/* w is 0 if untextured */
+	double intensity;
+};
+
+/* triangle mesh, flattened into contiguous arrays */
+struct Mesh
+{
+	float *pos;			/* xyz per vertex; w is 1 */
+	float *norm;			/* xyz per vertex */
+	float *uv;			/* uvw per vertex; w is 0 if untextured */
+	ulong nverts;
+	u32int *tris;			/* three per triangle, into the vertices */
+	ulong ntris;
+};
+
+/* texels are 0xRRGGBBAA words, laid out from the top-left */
+struct Texlevel
+{
+	ulong *data;
+	int w, h;
+	int bw;				/* blocks per row, if TBlocked */
+};
+
+struct Texture
+{
+	Texlevel *levels;		/* mip chain; levels[0] is the full image */
+	int nlevels;
+	int layout;
+	int filter;
+	int wrap;
+};
+
+/* screen-space triangle, ready to be rasterized */
+struct Primitive
+{
+	Triangle3 st;			/* screen-space triangle */
+	Triangle2 tt;			/* texture triangle */
+	Rectangle bbox;			/* clipped against the fb */
+	double zmin, zmax;		/* depth bounds */
+	double var_intensity[3];
+};
+
+/* primitives a shader unit binned into a tile */
+struct Bin
+{
+	ulong *prims;			/* indices into the unit's primtab */
+	ulong nprims;
+	ulong cap;
+};
+
+/* a unit's primitives for the frame in one job slot, binned */
+struct Binset
+{
+	Primitive *primtab;
+	ulong nprims;
+	ulong primcap;
+	Bin *bins;			/* one per tile */
+	int nbins;
+};
+
+/*
+ * a frame going through the shader units. the work is shared
+ * by them, grabbed through atomic cursors.
+ */
+struct Job
+{
+	Framebuf *fb;			/* only its geometry matters until SURaster */
+	Mesh *mesh;
+	Vertex *verts;			/* the mesh's, after the vertex shader */
+	int slot;			/* the units' binset it goes in */
+	int stage;			/* being run */
+	Channel *donec;			/* a unit is done with the stage */
+	long nextvert;			/* next batch of verts up for grabs */
+	long nexttri;			/* next batch of triangles up for grabs */
+	long nexttile;			/* next tile up for grabs */
+
+	uvlong uni_time;
+	Matrix3 uni_rot;
+	Matrix3 uni_mv;
+	Matrix3 uni_mvp;
+
+	Point3 (*vshader)(VSparams*);
+	ulong (*fshader)(FSparams*);
+};
+
 /* shader params */
 struct VSparams
 {
 	SUparams *su;
-	Point3 *p;
-	Point3 *n;
-	uint idx;
+	Vertex *v;
 };
 
 struct FSparams
 {
 	SUparams *su;
-	Memimage *frag;
 	Point p;
 	Point3 bc;
+	Point2 uv;			/* w is 0 if untextured */
+	Point2 uvdx, uvdy;		/* uv derivatives along x and y */
+	double lod;			/* of the model's texture */
 	uchar *cbuf;
 };
 
+/* pipeline stages, as timed */
+enum {
+	StClear,
+	StVertex,
+	StAssembly,
+	StTiles,	/* walking the tiles and clearing them */
+	StShade,	/* rasterizing, depth testing and shading the tiles' primitives */
+	StPresent,
+	NSTAGES,
+};
+
+typedef struct Stats Stats;
+struct Stats
+{
+	uvlong min, avg, max, acc, n, v;
+	uvlong hist[NSTATBUCKETS];	/* bucket i counts values in [2ⁱ,2ⁱ⁺¹) */
+};
+
+/* shader unit stages */
+enum {
+	SUVertex,	/* run the vertex shader over the unique vertices */
+	SUAssembly,	/* assemble the primitives and bin them */
+	SURaster,	/* rasterize the tiles owned by the unit */
+};
+
 /* shader unit params */
 struct SUparams
 {
 	Framebuf *fb;
-	OBJElem **b, **e;
+	Job *job;
 	int id;
-	Channel *donec;
+	Channel *workc;			/* jobs with a stage to run */
+
+	/* sort-middle state; bins are read by every unit during SURaster */
+	SUparams *units;
+	int nunits;
+	Binset binsets[NJOBSLOTS];
+	ulong nculled;			/* primitives culled this frame */
+	ulong nfrags;			/* fragments shaded this frame */
+	uvlong shadetime;		/* ns spent rasterizing and shading the tiles' primitives */
+	Stats stats[NSTAGES];		/* of the stages it runs */
 
 	double var_intensity[3];
 
+	/* the job's, copied in when a stage starts */
 	uvlong uni_time;
+	Matrix3 uni_rot;		/* model rotation around the y axis */
+	Matrix3 uni_mv;			/* model-view, rotation aside */
+	Matrix3 uni_mvp;		/* model-view-projection-viewport, ditto */
 
 	Point3 (*vshader)(VSparams*);
-	Memimage *(*fshader)(FSparams*);
+	ulong (*fshader)(FSparams*);
 };
 
 struct Shader
 {
 	char *name;
 	Point3 (*vshader)(VSparams*);
-	Memimage *(*fshader)(FSparams*);
+	ulong (*fshader)(FSparams*);	/* premultiplied RGBA; zero alpha discards */
+};
+
+/* depth bounds of a zbuf region. bigger is nearer */
+struct Zrange
+{
+	double zmin;			/* farthest */
+	double zmax;			/* nearest */
 };
 
 struct Framebuf
 {
 	Memimage *cb;
-	Memimage *zb;
-	double *zbuf;
-	Lock zbuflk;
-	Memimage *nb;	/* XXX DBG */
+	Memimage *zb;		/* depth visualization, resolved on demand */
+	void *zbuf;
+	int zfmt;
+	Memimage *nb;		/* debug overlays */
 	Rectangle r;
+	int ntilex, ntiley;	/* tile grid dimensions */
+	Zrange *tilez;		/* per tile */
+	Zrange *hiz;		/* per HIZSIZE block */
+	int nhizx, nhizy;	/* block grid dimensions */
+	uchar *pending;		/* per tile, yet to be cleared; nil unless clearing lazily */
 };
 
+/*
+ * triple buffered: the renderer owns the back buffer and the
+ * presenter the front one. each hands its buffer over by trading
+ * it for the ready one, which is the only thing swplk guards.
+ */
 struct Framebufctl
 {
-	Framebuf *fb[2];
-	uint idx;
+	Framebuf *fb[3];
+	uint front;		/* being presented */
+	uint ready;		/* last one finished */
+	uint back;		/* being rendered */
+	int fresh;		/* ready is newer than front */
 	Lock swplk;
 
 	void (*draw)(Framebufctl*, Memimage*, int);
 	void (*swap)(Framebufctl*);
 	void (*reset)(Framebufctl*);
-};
-
-typedef struct Stats Stats;
-struct Stats
-{
-	uvlong min, avg, max, acc, n, v;
+	Framebuf *(*getfb)(Framebufctl*);
+	Framebuf *(*getbackfb)(Framebufctl*);
 };
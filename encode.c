@@ -0,0 +1,197 @@
+#include <u.h>
+#include <libc.h>
+#include <flate.h>
+#include <thread.h>
+#include <draw.h>
+#include <memdraw.h>
+#include <mouse.h>
+#include <keyboard.h>
+#include <geometry.h>
+#include "libobj/obj.h"
+#include "dat.h"
+#include "fns.h"
+
+/*
+ * frame encoders. frames are RGBA32 images with premultiplied
+ * alpha, as they come out of the framebuffer.
+ */
+
+static void
+put32(uchar *p, ulong v)
+{
+	p[0] = v>>24;
+	p[1] = v>>16;
+	p[2] = v>>8;
+	p[3] = v;
+}
+
+/*
+ * binary PPM. it has no alpha, so pixels end up composited
+ * over black, which premultiplication already did.
+ */
+int
+writeppm(int fd, Memimage *i)
+{
+	uchar *buf, *p;
+	ulong *row;
+	char hdr[64];
+	int x, y, n;
+
+	n = snprint(hdr, sizeof hdr, "P6\n%d %d\n255\n", Dx(i->r), Dy(i->r));
+	if(write(fd, hdr, n) != n)
+		return -1;
+	buf = emalloc(3*Dx(i->r));
+	for(y = i->r.min.y; y < i->r.max.y; y++){
+		row = wordaddr(i, Pt(i->r.min.x,y));
+		for(x = 0, p = buf; x < Dx(i->r); x++){
+			*p++ = row[x]>>24;
+			*p++ = row[x]>>16;
+			*p++ = row[x]>>8;
+		}
+		if(write(fd, buf, p-buf) != p-buf){
+			free(buf);
+			return -1;
+		}
+	}
+	free(buf);
+	return 0;
+}
+
+typedef struct Pngenc Pngenc;
+struct Pngenc
+{
+	int fd;
+	uchar *raw;		/* filtered lines, ready to deflate */
+	long nraw;
+	long off;
+};
+
+static ulong *crctab;
+
+static int
+pngchunk(int fd, char *type, uchar *data, long n)
+{
+	uchar buf[8];
+	ulong crc;
+
+	put32(buf, n);
+	memmove(buf+4, type, 4);
+	crc = blockcrc(crctab, 0, type, 4);
+	crc = blockcrc(crctab, crc, data, n);
+	if(write(fd, buf, 8) != 8 || write(fd, data, n) != n)
+		return -1;
+	put32(buf, crc);
+	if(write(fd, buf, 4) != 4)
+		return -1;
+	return 0;
+}
+
+static int
+pngread(void *a, void *buf, int n)
+{
+	Pngenc *e;
+
+	e = a;
+	if(n > e->nraw - e->off)
+		n = e->nraw - e->off;
+	memmove(buf, e->raw + e->off, n);
+	e->off += n;
+	return n;
+}
+
+/* every block the deflater puts out becomes an IDAT chunk */
+static int
+pngwrite(void *a, void *buf, int n)
+{
+	Pngenc *e;
+
+	e = a;
+	if(pngchunk(e->fd, "IDAT", buf, n) < 0)
+		return -1;
+	return n;
+}
+
+/*
+ * 8-bit RGBA PNG. alpha is straight there, so pixels get
+ * unpremultiplied. lines go unfiltered: frames are written
+ * while rendering goes on, and that's cheaper than searching
+ * for the best filter.
+ */
+int
+writepng(int fd, Memimage *i)
+{
+	static int inited;
+	Pngenc e;
+	uchar ihdr[13], *p;
+	ulong *row, c, a;
+	int x, y, r;
+
+	if(!inited){
+		deflateinit();
+		crctab = mkcrctab(0xedb88320);
+		inited++;
+	}
+
+	if(write(fd, "\x89PNG\r\n\x1a\n", 8) != 8)
+		return -1;
+	put32(ihdr, Dx(i->r));
+	put32(ihdr+4, Dy(i->r));
+	ihdr[8] = 8;		/* depth */
+	ihdr[9] = 6;		/* RGBA */
+	ihdr[10] = ihdr[11] = ihdr[12] = 0;
+	if(pngchunk(fd, "IHDR", ihdr, sizeof ihdr) < 0)
+		return -1;
+
+	e.fd = fd;
+	e.nraw = Dy(i->r)*(1 + 4*Dx(i->r));
+	e.raw = emalloc(e.nraw);
+	e.off = 0;
+	p = e.raw;
+	for(y = i->r.min.y; y < i->r.max.y; y++){
+		row = wordaddr(i, Pt(i->r.min.x,y));
+		*p++ = 0;	/* no filter */
+		for(x = 0; x < Dx(i->r); x++){
+			c = row[x];
+			a = c & 0xFF;
+			if(a == 0){
+				p[0] = p[1] = p[2] = p[3] = 0;
+				p += 4;
+				continue;
+			}
+			*p++ = min((c>>24)*0xFF/a, 0xFF);
+			*p++ = min((c>>16 & 0xFF)*0xFF/a, 0xFF);
+			*p++ = min((c>>8 & 0xFF)*0xFF/a, 0xFF);
+			*p++ = a;
+		}
+	}
+	r = deflatezlib(&e, pngwrite, &e, pngread, 6, 0);
+	free(e.raw);
+	if(r != FlateOk){
+		werrstr("deflatezlib: %s", flateerr(r));
+		return -1;
+	}
+	return pngchunk(fd, "IEND", nil, 0);
+}
+
+/*
+ * write a frame to a file, in the format its extension calls
+ * for: .ppm, .png, and Plan 9 images otherwise.
+ */
+int
+writeframe(char *path, Memimage *i)
+{
+	char *ext;
+	int fd, r;
+
+	if((fd = create(path, OWRITE, 0644)) < 0)
+		return -1;
+	ext = strrchr(path, '.');
+	if(ext != nil && strcmp(ext, ".ppm") == 0)
+		r = writeppm(fd, i);
+	else if(ext != nil && strcmp(ext, ".png") == 0)
+		r = writepng(fd, i);
+	else
+		r = writememimage(fd, i);
+	close(fd);
+	return r;
+}
@@ -10,24 +10,155 @@
 #include "dat.h"
 #include "fns.h"
 
-extern int shownormals;	/* XXX DBG */
+extern int showoverlays;
 
+/*
+ * clear the color and depth buffers within r. the color buffer
+ * is transparent black, i.e. all zeroes, so it's a plain memset;
+ * so is a ZD24 depth buffer. rows that span the whole fb are
+ * contiguous, and get cleared in one go.
+ */
+void
+fbclearrect(Framebuf *fb, Rectangle r)
+{
+	long n, stride;
+	int y;
+
+	n = Dx(r);
+	stride = Dx(fb->r);
+	r = rectsubpt(r, fb->r.min);
+	if(n == stride){
+		n *= Dy(r);
+		r.max.y = r.min.y+1;
+	}
+	for(y = r.min.y; y < r.max.y; y++){
+		memset(byteaddr(fb->cb, addpt(fb->r.min, Pt(r.min.x,y))), 0, n*sizeof(ulong));
+		switch(fb->zfmt){
+		case ZFloat:
+			memsetf((float*)fb->zbuf + y*stride + r.min.x, Inf(-1), n);
+			break;
+		case ZD24:
+			memset((u32int*)fb->zbuf + y*stride + r.min.x, 0, n*sizeof(u32int));
+			break;
+		}
+	}
+}
+
+/*
+ * the rectangle covered by tile t.
+ */
+Rectangle
+tilerect(Framebuf *fb, int t)
+{
+	Rectangle r;
+
+	r.min = addpt(fb->r.min, Pt(t%fb->ntilex*TILESIZE, t/fb->ntilex*TILESIZE));
+	r.max = addpt(r.min, Pt(TILESIZE,TILESIZE));
+	rectclip(&r, fb->r);
+	return r;
+}
+
+/*
+ * the depth at p, relative to the fb, whatever the format. a
+ * clear pixel reads as -∞.
+ */
+double
+zget(Framebuf *fb, Point p)
+{
+	long i;
+
+	/* tiles waiting to be cleared are as good as clear */
+	if(fb->pending != nil && fb->pending[p.y/TILESIZE*fb->ntilex + p.x/TILESIZE])
+		return Inf(-1);
+	i = p.y*Dx(fb->r) + p.x;
+	switch(fb->zfmt){
+	case ZD24:
+		return ZD24F(((u32int*)fb->zbuf)[i]);
+	}
+	return ((float*)fb->zbuf)[i];
+}
+
+/*
+ * paint the depth buffer as grays, from black far away to white
+ * up close, leaving the untouched pixels transparent.
+ */
+static void
+zresolve(Framebuf *fb)
+{
+	ulong *zbp, g;
+	double z;
+	Point p;
+
+	if(fb->zb == nil)
+		fb->zb = eallocmemimage(fb->r, RGBA32);
+	for(p.y = fb->r.min.y; p.y < fb->r.max.y; p.y++){
+		zbp = wordaddr(fb->zb, Pt(fb->r.min.x,p.y));
+		for(p.x = fb->r.min.x; p.x < fb->r.max.x; p.x++){
+			z = zget(fb, subpt(p, fb->r.min));
+			if(z < 0){
+				*zbp++ = 0;
+				continue;
+			}
+			g = 0xFF*z;
+			*zbp++ = g<<24 | g<<16 | g<<8 | 0xFF;
+		}
+	}
+}
+
+/*
+ * present the latest finished frame. the lock is only held to
+ * trade the front buffer for it; the renderer never touches the
+ * front buffer, so it's composited unlocked.
+ */
 static void
 framebufctl_draw(Framebufctl *ctl, Memimage *dst, int showz)
 {
+	Framebuf *fb;
+	Rectangle r;
+	uint i;
+	int t;
+
 	lock(&ctl->swplk);
-	memimagedraw(dst, dst->r, showz? ctl->fb[ctl->idx]->zb: ctl->fb[ctl->idx]->cb, ZP, nil, ZP, SoverD);
-	/* XXX DBG */
-	if(shownormals)
-		memimagedraw(dst, dst->r, ctl->fb[ctl->idx]->nb, ZP, nil, ZP, SoverD);
+	if(ctl->fresh){
+		i = ctl->front;
+		ctl->front = ctl->ready;
+		ctl->ready = i;
+		ctl->fresh = 0;
+	}
 	unlock(&ctl->swplk);
+
+	fb = ctl->fb[ctl->front];
+	if(showz)
+		zresolve(fb);
+	if(showz || fb->pending == nil)
+		memimagedraw(dst, dst->r, showz? fb->zb: fb->cb, ZP, nil, ZP, SoverD);
+	else
+		/* pending tiles hold stale pixels and are meant to be clear */
+		for(t = 0; t < fb->ntilex*fb->ntiley; t++){
+			if(fb->pending[t])
+				continue;
+			r = tilerect(fb, t);
+			memimagedraw(dst, rectaddpt(rectsubpt(r, fb->r.min), dst->r.min), fb->cb, r.min, nil, ZP, SoverD);
+		}
+	if(showoverlays)
+		memimagedraw(dst, dst->r, fb->nb, ZP, nil, ZP, SoverD);
 }
 
+/*
+ * publish the back buffer as the ready one. if the presenter
+ * didn't get to the previous ready one, it's dropped and
+ * rendered over.
+ */
 static void
 framebufctl_swap(Framebufctl *ctl)
 {
+	uint i;
+
 	lock(&ctl->swplk);
-	ctl->idx ^= 1;
+	i = ctl->back;
+	ctl->back = ctl->ready;
+	ctl->ready = i;
+	ctl->fresh = 1;
 	unlock(&ctl->swplk);
 }
 
@@ -37,40 +168,160 @@ framebufctl_reset(Framebufctl *ctl)
 	Framebuf *fb;
 
 	/* address the back buffer—resetting the front buffer is VERBOTEN */
-	fb = ctl->fb[ctl->idx^1];
-	memsetd(fb->zbuf, Inf(-1), Dx(fb->r)*Dy(fb->r));
-	memfillcolor(fb->cb, DTransparent);
-	memfillcolor(fb->zb, DTransparent);
-	memfillcolor(fb->nb, DTransparent);	/* XXX DBG */
+	fb = ctl->fb[ctl->back];
+	if(fb->pending != nil)
+		memset(fb->pending, 1, fb->ntilex*fb->ntiley);
+	else
+		fbclearrect(fb, fb->r);
+	hizreset(fb);
+}
+
+static Framebuf *
+framebufctl_getfb(Framebufctl *ctl)
+{
+	return ctl->fb[ctl->front];
+}
+
+static Framebuf *
+framebufctl_getbackfb(Framebufctl *ctl)
+{
+	return ctl->fb[ctl->back];
+}
+
+void
+hizreset(Framebuf *fb)
+{
+	int i;
+
+	for(i = 0; i < fb->ntilex*fb->ntiley; i++)
+		fb->tilez[i].zmin = fb->tilez[i].zmax = Inf(-1);
+	for(i = 0; i < fb->nhizx*fb->nhizy; i++)
+		fb->hiz[i].zmin = fb->hiz[i].zmax = Inf(-1);
+}
+
+/*
+ * the farthest depth within r, which used to be old and can only
+ * have gone up since. the first pixel still at old settles it. r
+ * is read straight from the buffer, so it mustn't be pending.
+ */
+static double
+zminrect(Framebuf *fb, Rectangle r, double old)
+{
+	float *zfp, zf;
+	u32int *zqp, zq, oldq;
+	int x, y, stride;
+
+	stride = Dx(fb->r);
+	switch(fb->zfmt){
+	case ZD24:
+		oldq = old < 0? 0: ZD24(old);
+		zq = ~0;
+		for(y = r.min.y; y < r.max.y; y++){
+			zqp = (u32int*)fb->zbuf + y*stride;
+			for(x = r.min.x; x < r.max.x; x++){
+				if(zqp[x] <= oldq)
+					return old;
+				if(zqp[x] < zq)
+					zq = zqp[x];
+			}
+		}
+		return ZD24F(zq);
+	}
+	zf = Inf(1);
+	for(y = r.min.y; y < r.max.y; y++){
+		zfp = (float*)fb->zbuf + y*stride;
+		for(x = r.min.x; x < r.max.x; x++){
+			if(zfp[x] <= old)
+				return old;
+			if(zfp[x] < zf)
+				zf = zfp[x];
+		}
+	}
+	return zf;
+}
+
+/*
+ * refresh the farthest depth of the blocks of tile t set in the
+ * dirty mask—bit i being block (i%HIZPERTILE, i/HIZPERTILE) within
+ * the tile—and then that of the tile itself. the nearest depths
+ * are kept up to date by the rasterizer as it writes.
+ */
+void
+hizupdate(Framebuf *fb, int t, ulong dirty)
+{
+	Zrange *tz, *blk;
+	Rectangle r;
+	int i, bx, by;
+
+	tz = &fb->tilez[t];
+	tz->zmin = Inf(1);
+	for(i = 0; i < HIZPERTILE*HIZPERTILE; i++){
+		bx = t%fb->ntilex*HIZPERTILE + i%HIZPERTILE;
+		by = t/fb->ntilex*HIZPERTILE + i/HIZPERTILE;
+		if(bx >= fb->nhizx || by >= fb->nhizy)
+			continue;
+		blk = &fb->hiz[by*fb->nhizx + bx];
+		if((dirty & 1<<i) != 0){
+			r.min = Pt(bx*HIZSIZE, by*HIZSIZE);
+			r.max = addpt(r.min, Pt(HIZSIZE,HIZSIZE));
+			rectclip(&r, rectsubpt(fb->r, fb->r.min));
+			blk->zmin = zminrect(fb, r, blk->zmin);
+		}
+		tz->zmin = fmin(tz->zmin, blk->zmin);
+	}
 }
 
+/*
+ * with lazyclear set, resetting the fb only marks its tiles as
+ * pending, and they get cleared by the first unit to rasterize
+ * anything into them. tiles nothing touches never get cleared.
+ */
 Framebuf *
-mkfb(Rectangle r)
+mkfb(Rectangle r, int zfmt, int lazyclear)
 {
 	Framebuf *fb;
 
 	fb = emalloc(sizeof *fb);
 	fb->cb = eallocmemimage(r, RGBA32);
-	fb->zb = eallocmemimage(r, RGBA32);
-	fb->zbuf = emalloc(Dx(r)*Dy(r)*sizeof(*fb->zbuf));
-	memsetd(fb->zbuf, Inf(-1), Dx(r)*Dy(r));
-	memset(&fb->zbuflk, 0, sizeof(fb->zbuflk));
-	fb->nb = eallocmemimage(r, RGBA32);	/* XXX DBG */
+	fb->zb = nil;
+	/* both formats take 32 bits */
+	fb->zbuf = emalloc(Dx(r)*Dy(r)*sizeof(u32int));
+	fb->zfmt = zfmt;
+	fb->nb = eallocmemimage(r, RGBA32);
 	fb->r = r;
+	fb->ntilex = (Dx(r)+TILESIZE-1)/TILESIZE;
+	fb->ntiley = (Dy(r)+TILESIZE-1)/TILESIZE;
+	fb->tilez = emalloc(fb->ntilex*fb->ntiley*sizeof(*fb->tilez));
+	fb->nhizx = (Dx(r)+HIZSIZE-1)/HIZSIZE;
+	fb->nhizy = (Dy(r)+HIZSIZE-1)/HIZSIZE;
+	fb->hiz = emalloc(fb->nhizx*fb->nhizy*sizeof(*fb->hiz));
+	fb->pending = nil;
+	if(lazyclear){
+		fb->pending = emalloc(fb->ntilex*fb->ntiley);
+		memset(fb->pending, 0, fb->ntilex*fb->ntiley);
+	}
+	fbclearrect(fb, fb->r);
+	hizreset(fb);
 	return fb;
 }
 
 Framebufctl *
-newfbctl(Rectangle r)
+newfbctl(Rectangle r, int zfmt, int lazyclear)
 {
 	Framebufctl *fc;
 
 	fc = emalloc(sizeof *fc);
 	memset(fc, 0, sizeof *fc);
-	fc->fb[0] = mkfb(r);
-	fc->fb[1] = mkfb(r);
+	fc->fb[0] = mkfb(r, zfmt, lazyclear);
+	fc->fb[1] = mkfb(r, zfmt, lazyclear);
+	fc->fb[2] = mkfb(r, zfmt, lazyclear);
+	fc->front = 0;
+	fc->ready = 1;
+	fc->back = 2;
 	fc->draw = framebufctl_draw;
 	fc->swap = framebufctl_swap;
 	fc->reset = framebufctl_reset;
+	fc->getfb = framebufctl_getfb;
+	fc->getbackfb = framebufctl_getbackfb;
 	return fc;
 }
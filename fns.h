@@ -12,8 +12,47 @@ Image *eallocimage(Display*, Rectangle, ulong, int, ulong);
 Memimage *eallocmemimage(Rectangle, ulong);
 
 /* fb */
-Framebuf *mkfb(Rectangle);
-Framebufctl *newfbctl(Rectangle);
+void hizreset(Framebuf*);
+void hizupdate(Framebuf*, int, ulong);
+void fbclearrect(Framebuf*, Rectangle);
+Rectangle tilerect(Framebuf*, int);
+double zget(Framebuf*, Point);
+Framebuf *mkfb(Rectangle, int, int);
+Framebufctl *newfbctl(Rectangle, int, int);
+
+/* clip */
+int clipcode(Point3, Rectangle);
+int cliptriangle(Vertex*, Vertex**, int, Rectangle);
+
+/* trace */
+void tracebegin(char*);
+void traceend(char*);
+int writetrace(char*);
+
+/* encode */
+int writeppm(int, Memimage*);
+int writepng(int, Memimage*);
+int writeframe(char*, Memimage*);
+
+/* mesh */
+Mesh *compilemesh(OBJ*);
+Mesh *loadmesh(char*);
+
+/* texture */
+Texture *alloctexture(int, int, int);
+void texput(Texture*, int, int, ulong);
+void mkmips(Texture*);
+ulong premul(int, int, int, int);
+Texture *readtexture(char*, int);
+void freetexture(Texture*);
+double texlod(Texture*, Point2, Point2);
+ulong texsample(Texture*, Point2, double);
+
+/* tga */
+Texture *readtga(char*, int);
+
+/* png */
+Texture *readpng(char*, int);
 
 /* shadeop */
 double step(double, double);
@@ -25,7 +64,5 @@ int max(int, int);
 double fmin(double, double);
 double fmax(double, double);
 void swap(int*, int*);
-void memsetd(double*, double, usize);
-Memimage *readtga(char*);
-Memimage *readpng(char*);
+void memsetf(float*, float, usize);
 Memimage *rgb(ulong);
@@ -11,15 +11,30 @@
 #include "fns.h"
 
 Stats fps;
+Stats stagestats[NSTAGES];	/* per frame */
+char *stagenames[NSTAGES] = {
+	[StClear]	= "clear",
+	[StVertex]	= "vertex",
+	[StAssembly]	= "assembly",
+	[StTiles]	= "tiles",
+	[StShade]	= "raster+shade",
+	[StPresent]	= "present",
+};
 Framebufctl *fbctl;
 Memimage *screenfb;
-Memimage *red, *green, *blue;
-OBJ *model;
-Memimage *modeltex;
+Mesh *mesh;
+Texture *modeltex;
 Channel *drawc;
+Channel *stopc;			/* asks the renderer to stop; nil if there's none */
 int nprocs;
 int showzbuffer;
-int shownormals;	/* XXX DBG */
+int cullmode = CullBack;
+ulong nculled;			/* last frame's */
+ulong nfrags;			/* ditto */
+int showoverlays;
+int showtimings;
+extern int tracing;
+char *tracepath;
 
 char winspec[32];
 Point3 light = {0,1,1,1};	/* global directional light */
@@ -33,25 +48,56 @@ double scale;
 void
 updatestats(Stats *s, uvlong v)
 {
+	int b;
+
 	s->v = v;
 	s->n++;
 	s->acc += v;
 	s->avg = s->acc/s->n;
 	s->min = v < s->min || s->n == 1? v: s->min;
 	s->max = v > s->max || s->n == 1? v: s->max;
+	for(b = 0; b < NSTATBUCKETS-1 && v>>b+1 != 0; b++)
+		;
+	s->hist[b]++;
 }
 
+/*
+ * the value under which a fraction p of the samples fall, read
+ * off the histogram. it's the top of the bucket it lands in, so
+ * it can be up to twice too high, but never too low.
+ */
+uvlong
+statpct(Stats *s, double p)
+{
+	uvlong n, acc, v;
+	int b;
+
+	if(s->n == 0)
+		return 0;
+	n = ceil(p*s->n);
+	acc = 0;
+	for(b = 0; b < NSTATBUCKETS; b++)
+		if((acc += s->hist[b]) >= n)
+			break;
+	v = b < NSTATBUCKETS-1? (2ULL<<b) - 1: s->max;
+	return v < s->min? s->min: v > s->max? s->max: v;
+}
+
+/*
+ * the line drawing below stores opaque RGBA32 words straight into
+ * dst, so unlike memdraw it's safe to use off the main proc.
+ */
 void
-pixel(Memimage *dst, Point p, Memimage *src)
+pixel(Memimage *dst, Point p, ulong c)
 {
-	if(dst == nil || src == nil)
+	if(dst == nil || !ptinrect(p, dst->r))
 		return;
 
-	memimagedraw(dst, rectaddpt(Rect(0,0,1,1), p), src, ZP, nil, ZP, SoverD);
+	*wordaddr(dst, p) = c;
 }
 
 void
-bresenham(Memimage *dst, Point p0, Point p1, Memimage *src)
+bresenham(Memimage *dst, Point p0, Point p1, ulong c)
 {
 	int steep = 0, Δe, e, Δy;
 	Point p, dp;
@@ -76,7 +122,7 @@ bresenham(Memimage *dst, Point p0, Point p1, Memimage *src)
 
 	for(p = p0; p.x <= p1.x; p.x++){
 		if(steep) swap(&p.x, &p.y);
-		pixel(dst, p, src);
+		pixel(dst, p, c);
 		if(steep) swap(&p.x, &p.y);
 
 		e += Δe;
@@ -94,7 +140,7 @@ ycoordsort(void *a, void *b)
 }
 
 void
-triangle(Memimage *dst, Point p0, Point p1, Point p2, Memimage *src)
+triangle(Memimage *dst, Point p0, Point p1, Point p2, ulong c)
 {
 	Triangle t;
 
@@ -104,13 +150,13 @@ triangle(Memimage *dst, Point p0, Point p1, Point p2, Memimage *src)
 
 	qsort(t, nelem(t), sizeof(Point), ycoordsort);
 
-	bresenham(dst, t[0], t[1], src);
-	bresenham(dst, t[1], t[2], src);
-	bresenham(dst, t[2], t[0], src);
+	bresenham(dst, t[0], t[1], c);
+	bresenham(dst, t[1], t[2], c);
+	bresenham(dst, t[2], t[0], c);
 }
 
 void
-filltriangle(Memimage *dst, Point p0, Point p1, Point p2, Memimage *src)
+filltriangle(Memimage *dst, Point p0, Point p1, Point p2, ulong c)
 {
 	int y;
 	double m₀₂, m₀₁, m₁₂;
@@ -132,10 +178,10 @@ filltriangle(Memimage *dst, Point p0, Point p1, Point p2, Memimage *src)
 
 	/* first half */
 	for(y = t[0].y; y <= t[1].y; y++)
-		bresenham(dst, Pt(t[0].x + (y-t[0].y)*m₀₂,y), Pt(t[0].x + (y-t[0].y)*m₀₁,y), src);
+		bresenham(dst, Pt(t[0].x + (y-t[0].y)*m₀₂,y), Pt(t[0].x + (y-t[0].y)*m₀₁,y), c);
 	/* second half */
 	for(; y <= t[2].y; y++)
-		bresenham(dst, Pt(t[0].x + (y-t[0].y)*m₀₂,y), Pt(t[1].x + (y-t[1].y)*m₁₂,y), src);
+		bresenham(dst, Pt(t[0].x + (y-t[0].y)*m₀₂,y), Pt(t[1].x + (y-t[1].y)*m₁₂,y), c);
 }
 
 void
@@ -174,348 +220,916 @@ lookat(Point3 eye, Point3 o, Point3 up)
 Point3
 vertshader(VSparams *sp)
 {
-	Matrix3 S = {
-		scale, 0, 0, 0,
-		0, scale, 0, 0,
-		0, 0, scale, 0,
-		0, 0, 0, 1,
-	}, M, V;
-
-	identity3(M);
-	identity3(V);
-	mulm3(M, rota);
-	mulm3(M, S);
-	mulm3(V, view);
-	mulm3(V, M);
-
-	*sp->n = qrotate(*sp->n, Vec3(0,1,0), θ+fmod(ω*sp->su->uni_time/1e9, 2*PI));
-	sp->su->var_intensity[sp->idx] = fmax(0, dotvec3(*sp->n, light));
-	*sp->n = xform3(*sp->n, M);
-	*sp->p = qrotate(*sp->p, Vec3(0,1,0), θ+fmod(ω*sp->su->uni_time/1e9, 2*PI));
-	*sp->p = xform3(*sp->p, V);
-	return *sp->p;
-}
-
-Memimage *
+	sp->v->n = xform3(sp->v->n, sp->su->uni_rot);
+	sp->v->intensity = fmax(0, dotvec3(sp->v->n, light));
+	sp->v->n = xform3(sp->v->n, sp->su->uni_mv);
+	return xform3(xform3(sp->v->p, sp->su->uni_rot), sp->su->uni_mvp);
+}
+
+/*
+ * the model's texture color at the fragment, white if there's none.
+ */
+static ulong
+texcolor(FSparams *sp)
+{
+	if(modeltex == nil || sp->uv.w == 0)
+		return 0xFFFFFFFF;
+	return texsample(modeltex, sp->uv, sp->lod);
+}
+
+ulong
 gouraudshader(FSparams *sp)
 {
 	double intens;
 
 	intens = dotvec3(Vec3(sp->su->var_intensity[0], sp->su->var_intensity[1], sp->su->var_intensity[2]), sp->bc);
+	*(ulong*)sp->cbuf = texcolor(sp);
 	sp->cbuf[1] *= intens;
 	sp->cbuf[2] *= intens;
 	sp->cbuf[3] *= intens;
-	memfillcolor(sp->frag, *(ulong*)sp->cbuf);
-
-	return sp->frag;
+	return *(ulong*)sp->cbuf;
 }
 
-Memimage *
+ulong
 toonshader(FSparams *sp)
 {
 	double intens;
 
 	intens = dotvec3(Vec3(sp->su->var_intensity[0], sp->su->var_intensity[1], sp->su->var_intensity[2]), sp->bc);
 	intens = intens > 0.85? 1: intens > 0.60? 0.80: intens > 0.45? 0.60: intens > 0.30? 0.45: intens > 0.15? 0.30: 0;
+	sp->cbuf[0] = 0xFF;
 	sp->cbuf[1] = 0;
 	sp->cbuf[2] = 155*intens;
 	sp->cbuf[3] = 255*intens;
-	memfillcolor(sp->frag, *(ulong*)sp->cbuf);
+	return *(ulong*)sp->cbuf;
+}
 
-	return sp->frag;
+/*
+ * composite a premultiplied RGBA fragment over the dst color.
+ */
+static ulong
+blend(ulong dst, ulong src)
+{
+	ulong a, r;
+	int i;
+
+	a = 0xFF - (src&0xFF);
+	r = 0;
+	for(i = 0; i < 32; i += 8)
+		r |= (ulong)min(((src>>i)&0xFF) + ((dst>>i)&0xFF)*a/0xFF, 0xFF)<<i;
+	return r;
 }
 
-void
-rasterize(SUparams *params, Triangle3 st, Triangle2 tt, Memimage *frag)
+/*
+ * pixels are rasterized in 2x2 quads. lane i of a quad lies at
+ * (i&1, i>>1) from its origin.
+ */
+enum {
+	QUADSIZE = 2,
+	NLANES = QUADSIZE*QUADSIZE,
+	ALLLANES = (1<<NLANES)-1,
+};
+
+/*
+ * returns the mask of hiz blocks within the tile whose farthest
+ * depth got overwritten, as expected by hizupdate. their nearest
+ * depth, and the tile's, are kept up to date here.
+ */
+ulong
+rasterize(SUparams *params, Primitive *prim, Rectangle clipr)
 {
 	FSparams fsp;
-	Triangle2 st₂, tt₂;
+	Framebuf *fb;
+	Triangle3 st;
+	Triangle2 st₂, tt;
 	Rectangle bbox;
-	Point p, tp;
-	Point3 bc;
-	double z, w, depth;
+	Point p;
+	double area;
+	double e[3], erow[3], Δex[3], Δey[3];	/* normalized edge functions, i.e. barycentric coords */
+	double z, zrow, Δzx, Δzy, w, wrow, Δwx, Δwy;
+	double le[3][NLANES], lz[NLANES], lw[NLANES];	/* per-lane offsets */
+	double qe[3][NLANES], qd[NLANES];		/* per-lane values */
+	float *zfp[QUADSIZE];
+	u32int *zqp[QUADSIZE], zq[NLANES];
+	ulong *cbp[QUADSIZE], c, dirty;
+	double zold, znew;
 	uchar cbuf[4];
+	int i, j, mask, colmask, rowmask, ztest, textured, far;
+	Zrange *blk, *tz;
 
+	fb = params->fb;
+	st = prim->st;
+	tt = prim->tt;
 	st₂.p0 = Pt2(st.p0.x/st.p0.w, st.p0.y/st.p0.w, 1);
 	st₂.p1 = Pt2(st.p1.x/st.p1.w, st.p1.y/st.p1.w, 1);
 	st₂.p2 = Pt2(st.p2.x/st.p2.w, st.p2.y/st.p2.w, 1);
-	/* find the triangle's bbox and clip it against the fb */
-	bbox = Rect(
-		min(min(st₂.p0.x, st₂.p1.x), st₂.p2.x), min(min(st₂.p0.y, st₂.p1.y), st₂.p2.y),
-		max(max(st₂.p0.x, st₂.p1.x), st₂.p2.x)+1, max(max(st₂.p0.y, st₂.p1.y), st₂.p2.y)+1
-	);
-	bbox.min.x = max(bbox.min.x, params->fb->r.min.x);
-	bbox.min.y = max(bbox.min.y, params->fb->r.min.y);
-	bbox.max.x = min(bbox.max.x, params->fb->r.max.x);
-	bbox.max.y = min(bbox.max.y, params->fb->r.max.y);
-	cbuf[0] = 0xFF;
+	/* the bbox was clipped against the fb during binning */
+	bbox = prim->bbox;
+	if(!rectclip(&bbox, clipr))
+		return 0;
+
+	area = (st₂.p1.x - st₂.p0.x)*(st₂.p2.y - st₂.p0.y) - (st₂.p1.y - st₂.p0.y)*(st₂.p2.x - st₂.p0.x);
+	if(fabs(area) < 1e-5)
+		return 0;
+
+	/*
+	 * set up the edge functions once, evaluated at the origin of
+	 * the first quad, and from there on just step them along x and y.
+	 * tiles are aligned to the quad grid, so quads never straddle them.
+	 */
+	p = Pt(bbox.min.x & ~(QUADSIZE-1), bbox.min.y & ~(QUADSIZE-1));
+	Δex[0] = (st₂.p1.y - st₂.p2.y)/area;
+	Δey[0] = (st₂.p2.x - st₂.p1.x)/area;
+	Δex[1] = (st₂.p2.y - st₂.p0.y)/area;
+	Δey[1] = (st₂.p0.x - st₂.p2.x)/area;
+	Δex[2] = (st₂.p0.y - st₂.p1.y)/area;
+	Δey[2] = (st₂.p1.x - st₂.p0.x)/area;
+	erow[0] = (p.x - st₂.p1.x)*Δex[0] + (p.y - st₂.p1.y)*Δey[0];
+	erow[1] = (p.x - st₂.p2.x)*Δex[1] + (p.y - st₂.p2.y)*Δey[1];
+	erow[2] = (p.x - st₂.p0.x)*Δex[2] + (p.y - st₂.p0.y)*Δey[2];
+
+	/* z and w are affine in screen space too */
+	zrow = st.p0.z*erow[0] + st.p1.z*erow[1] + st.p2.z*erow[2];
+	Δzx = st.p0.z*Δex[0] + st.p1.z*Δex[1] + st.p2.z*Δex[2];
+	Δzy = st.p0.z*Δey[0] + st.p1.z*Δey[1] + st.p2.z*Δey[2];
+	wrow = st.p0.w*erow[0] + st.p1.w*erow[1] + st.p2.w*erow[2];
+	Δwx = st.p0.w*Δex[0] + st.p1.w*Δex[1] + st.p2.w*Δex[2];
+	Δwy = st.p0.w*Δey[0] + st.p1.w*Δey[1] + st.p2.w*Δey[2];
+
+	for(i = 0; i < NLANES; i++){
+		for(j = 0; j < 3; j++)
+			le[j][i] = (i&1)*Δex[j] + (i>>1)*Δey[j];
+		lz[i] = (i&1)*Δzx + (i>>1)*Δzy;
+		lw[i] = (i&1)*Δwx + (i>>1)*Δwy;
+	}
+
+	memmove(params->var_intensity, prim->var_intensity, sizeof params->var_intensity);
 	fsp.su = params;
-	fsp.frag = frag;
 	fsp.cbuf = cbuf;
-
-	for(p.y = bbox.min.y; p.y < bbox.max.y; p.y++)
-		for(p.x = bbox.min.x; p.x < bbox.max.x; p.x++){
-			bc = barycoords(st₂, Pt2(p.x,p.y,1));
-			if(bc.x < 0 || bc.y < 0 || bc.z < 0)
+	textured = (tt.p0.w + tt.p1.w + tt.p2.w) != 0;
+	fsp.uv = Pt2(0,0,0);
+	/*
+	 * uv is interpolated affinely in screen space, so its
+	 * derivatives—and the lod of every quad—are the same
+	 * across the whole triangle.
+	 */
+	fsp.uvdx = Vec2(
+		tt.p0.x*Δex[0] + tt.p1.x*Δex[1] + tt.p2.x*Δex[2],
+		tt.p0.y*Δex[0] + tt.p1.y*Δex[1] + tt.p2.y*Δex[2]);
+	fsp.uvdy = Vec2(
+		tt.p0.x*Δey[0] + tt.p1.x*Δey[1] + tt.p2.x*Δey[2],
+		tt.p0.y*Δey[0] + tt.p1.y*Δey[1] + tt.p2.y*Δey[2]);
+	fsp.lod = textured && modeltex != nil? texlod(modeltex, fsp.uvdx, fsp.uvdy): 0;
+	tz = &fb->tilez[(clipr.min.y - fb->r.min.y)/TILESIZE*fb->ntilex + (clipr.min.x - fb->r.min.x)/TILESIZE];
+	dirty = 0;
+
+	/* the unit owns the tile, so nobody else touches these pixels */
+	for(; p.y < bbox.max.y; p.y += QUADSIZE){
+		rowmask = ALLLANES;
+		if(p.y < bbox.min.y)
+			rowmask &= ~0x3;
+		if(p.y+1 >= bbox.max.y)
+			rowmask &= ~0xC;
+		for(i = 0; i < QUADSIZE; i++){
+			cbp[i] = wordaddr(fb->cb, Pt(0,p.y+i));
+			zfp[i] = (float*)fb->zbuf + (p.y+i)*Dx(fb->r);
+			zqp[i] = (u32int*)fb->zbuf + (p.y+i)*Dx(fb->r);
+		}
+		e[0] = erow[0];
+		e[1] = erow[1];
+		e[2] = erow[2];
+		z = zrow;
+		w = wrow;
+		for(p.x = bbox.min.x & ~(QUADSIZE-1); p.x < bbox.max.x; p.x += QUADSIZE,
+		    e[0] += QUADSIZE*Δex[0], e[1] += QUADSIZE*Δex[1], e[2] += QUADSIZE*Δex[2],
+		    z += QUADSIZE*Δzx, w += QUADSIZE*Δwx){
+			/* quads never straddle hiz blocks either */
+			blk = &fb->hiz[p.y/HIZSIZE*fb->nhizx + p.x/HIZSIZE];
+			if(prim->zmax <= blk->zmin)
+				continue;
+			/* and if it's in front of the whole block there's no need to test */
+			ztest = prim->zmin <= blk->zmax;
+
+			colmask = rowmask;
+			if(p.x < bbox.min.x)
+				colmask &= ~0x5;
+			if(p.x+1 >= bbox.max.x)
+				colmask &= ~0xA;
+
+			/* coverage */
+			mask = 0;
+			for(i = 0; i < NLANES; i++){
+				qe[0][i] = e[0] + le[0][i];
+				qe[1][i] = e[1] + le[1][i];
+				qe[2][i] = e[2] + le[2][i];
+				mask |= (qe[0][i] >= 0 && qe[1][i] >= 0 && qe[2][i] >= 0) << i;
+			}
+			mask &= colmask;
+			if(mask == 0)
 				continue;
 
-			z = st.p0.z*bc.x + st.p1.z*bc.y + st.p2.z*bc.z;
-			w = st.p0.w*bc.x + st.p1.w*bc.y + st.p2.w*bc.z;
-			depth = fclamp(z/w, 0, 1);
-			lock(&params->fb->zbuflk);
-			if(depth <= params->fb->zbuf[p.x + p.y*Dx(params->fb->r)]){
-				unlock(&params->fb->zbuflk);
+			/* depth; lanes outside the triangle could have w = 0 */
+			for(i = 0; i < NLANES; i++){
+				if((mask & 1<<i) == 0)
+					continue;
+				qd[i] = (z + lz[i])/(w + lw[i]);
+				qd[i] = qd[i] < 0? 0: qd[i] > 1? 1: qd[i];
+				if(fb->zfmt == ZD24){
+					zq[i] = ZD24(qd[i]);
+					if(ztest && zq[i] <= zqp[i>>1][p.x + (i&1)])
+						mask &= ~(1<<i);
+				}else if(ztest && (float)qd[i] <= zfp[i>>1][p.x + (i&1)])
+					mask &= ~(1<<i);
+			}
+			if(mask == 0)
 				continue;
+
+			/*
+			 * depth only ever goes up, so the block's nearest value
+			 * just follows the writes. its farthest one needs looking
+			 * for again only when a pixel that far gets overwritten.
+			 */
+			far = 0;
+			for(i = 0; i < NLANES; i++){
+				if((mask & 1<<i) == 0)
+					continue;
+				if(fb->zfmt == ZD24){
+					zold = ZD24F(zqp[i>>1][p.x + (i&1)]);
+					zqp[i>>1][p.x + (i&1)] = zq[i];
+					znew = ZD24F(zq[i]);
+				}else{
+					zold = zfp[i>>1][p.x + (i&1)];
+					znew = zfp[i>>1][p.x + (i&1)] = qd[i];
+				}
+				far |= zold <= blk->zmin;
+				if(znew > blk->zmax)
+					blk->zmax = znew;
 			}
-			params->fb->zbuf[p.x + p.y*Dx(params->fb->r)] = depth;
-
-			cbuf[1] = 0xFF*depth;
-			cbuf[2] = 0xFF*depth;
-			cbuf[3] = 0xFF*depth;
-			memfillcolor(frag, *(ulong*)cbuf);
-			pixel(params->fb->zb, p, frag);
-			unlock(&params->fb->zbuflk);
-
-			cbuf[0] = 0xFF;
-			if((tt.p0.w + tt.p1.w + tt.p2.w) != 0){
-				tt₂.p0 = mulpt2(tt.p0, bc.x);
-				tt₂.p1 = mulpt2(tt.p1, bc.y);
-				tt₂.p2 = mulpt2(tt.p2, bc.z);
-
-				tp.x = (tt₂.p0.x + tt₂.p1.x + tt₂.p2.x)*Dx(modeltex->r);
-				tp.y = (1 - (tt₂.p0.y + tt₂.p1.y + tt₂.p2.y))*Dy(modeltex->r);
-
-				switch(modeltex->chan){
-				case RGB24:
-					unloadmemimage(modeltex, rectaddpt(Rect(0,0,1,1), tp), cbuf+1, sizeof cbuf - 1);
+			if(blk->zmax > tz->zmax)
+				tz->zmax = blk->zmax;
+			if(far)
+				dirty |= 1UL << ((p.y - clipr.min.y)/HIZSIZE*HIZPERTILE + (p.x - clipr.min.x)/HIZSIZE);
+
+			for(i = 0; i < NLANES; i++){
+				if((mask & 1<<i) == 0)
+					continue;
+
+				if(textured)
+					fsp.uv = Pt2(
+						tt.p0.x*qe[0][i] + tt.p1.x*qe[1][i] + tt.p2.x*qe[2][i],
+						tt.p0.y*qe[0][i] + tt.p1.y*qe[1][i] + tt.p2.y*qe[2][i],
+						1);
+				fsp.p = Pt(p.x + (i&1), p.y + (i>>1));
+				fsp.bc.x = qe[0][i];
+				fsp.bc.y = qe[1][i];
+				fsp.bc.z = qe[2][i];
+				fsp.bc.w = 1;
+				c = params->fshader(&fsp);
+				params->nfrags++;
+				/* opaque fragments go straight in; fully transparent ones are discarded */
+				switch(c&0xFF){
+				case 0xFF:
+					cbp[i>>1][fsp.p.x] = c;
+					break;
+				case 0:
 					break;
-				case RGBA32:
-					unloadmemimage(modeltex, rectaddpt(Rect(0,0,1,1), tp), cbuf, sizeof cbuf);
+				default:
+					cbp[i>>1][fsp.p.x] = blend(cbp[i>>1][fsp.p.x], c);
 					break;
 				}
-			}else
-				memset(cbuf+1, 0xFF, sizeof cbuf - 1);
+			}
+		}
+		for(i = 0; i < 3; i++)
+			erow[i] += QUADSIZE*Δey[i];
+		zrow += QUADSIZE*Δzy;
+		wrow += QUADSIZE*Δwy;
+	}
+	return dirty;
+}
+
+/* outcodes against the frustum planes, near first */
+enum {
+	OCNear	= 1<<0,
+	OCLeft	= 1<<1,
+	OCRight	= 1<<2,
+	OCTop	= 1<<3,
+	OCBottom	= 1<<4,
+};
+
+/*
+ * the screen-space planes scaled by w, so no division is
+ * needed and it holds for vertices behind the camera too.
+ */
+static int
+outcode(Point3 p, Rectangle r)
+{
+	int c;
+
+	c = 0;
+	if(p.w <= 0)
+		c |= OCNear;
+	if(p.x < r.min.x*p.w)
+		c |= OCLeft;
+	if(p.x > r.max.x*p.w)
+		c |= OCRight;
+	if(p.y < r.min.y*p.w)
+		c |= OCTop;
+	if(p.y > r.max.y*p.w)
+		c |= OCBottom;
+	return c;
+}
 
-			fsp.p = p;
-			fsp.bc = bc;
-			pixel(params->fb->cb, p, params->fshader(&fsp));
+/*
+ * tell whether a triangle can be thrown away before it gets
+ * binned: when it's entirely outside one of the frustum planes,
+ * when it has no area or when it faces the culled way.
+ */
+static int
+cull(Triangle3 *st, Rectangle r)
+{
+	Triangle2 st₂;
+	double area;
+	int c0, c1, c2;
+
+	c0 = outcode(st->p0, r);
+	c1 = outcode(st->p1, r);
+	c2 = outcode(st->p2, r);
+	if(c0 & c1 & c2)
+		return 1;
+	/* no sensible orientation until it's clipped */
+	if((c0 | c1 | c2) & OCNear)
+		return 0;
+
+	st₂.p0 = Pt2(st->p0.x/st->p0.w, st->p0.y/st->p0.w, 1);
+	st₂.p1 = Pt2(st->p1.x/st->p1.w, st->p1.y/st->p1.w, 1);
+	st₂.p2 = Pt2(st->p2.x/st->p2.w, st->p2.y/st->p2.w, 1);
+	area = (st₂.p1.x - st₂.p0.x)*(st₂.p2.y - st₂.p0.y) - (st₂.p1.y - st₂.p0.y)*(st₂.p2.x - st₂.p0.x);
+	if(fabs(area) < 1e-5)
+		return 1;
+	switch(cullmode){
+	case CullBack:
+		return area > 0;
+	case CullFront:
+		return area < 0;
+	}
+	return 0;
+}
+
+/*
+ * store the primitive and file it into every tile its bbox overlaps.
+ */
+static void
+binprim(SUparams *params, Primitive *prim)
+{
+	Framebuf *fb;
+	Binset *bs;
+	Triangle2 st₂;
+	Rectangle bbox;
+	Bin *bin;
+	double z[3];
+	int tx, ty;
+
+	fb = params->fb;
+	bs = &params->binsets[params->job->slot];
+	st₂.p0 = Pt2(prim->st.p0.x/prim->st.p0.w, prim->st.p0.y/prim->st.p0.w, 1);
+	st₂.p1 = Pt2(prim->st.p1.x/prim->st.p1.w, prim->st.p1.y/prim->st.p1.w, 1);
+	st₂.p2 = Pt2(prim->st.p2.x/prim->st.p2.w, prim->st.p2.y/prim->st.p2.w, 1);
+	/* find the triangle's bbox and clip it against the fb */
+	bbox = Rect(
+		min(min(st₂.p0.x, st₂.p1.x), st₂.p2.x), min(min(st₂.p0.y, st₂.p1.y), st₂.p2.y),
+		max(max(st₂.p0.x, st₂.p1.x), st₂.p2.x)+1, max(max(st₂.p0.y, st₂.p1.y), st₂.p2.y)+1
+	);
+	if(!rectclip(&bbox, fb->r))
+		return;
+	prim->bbox = bbox;
+
+	/*
+	 * depth is z/w interpolated in screen space, which is monotonic
+	 * along any line, so the vertices bound it—as long as w doesn't
+	 * change sign. otherwise fall back to the clamping range.
+	 */
+	if(prim->st.p0.w > 0 && prim->st.p1.w > 0 && prim->st.p2.w > 0){
+		z[0] = fclamp(prim->st.p0.z/prim->st.p0.w, 0, 1);
+		z[1] = fclamp(prim->st.p1.z/prim->st.p1.w, 0, 1);
+		z[2] = fclamp(prim->st.p2.z/prim->st.p2.w, 0, 1);
+		prim->zmin = fmin(fmin(z[0], z[1]), z[2]);
+		prim->zmax = fmax(fmax(z[0], z[1]), z[2]);
+	}else{
+		prim->zmin = 0;
+		prim->zmax = 1;
+	}
+
+	if(bs->nprims >= bs->primcap){
+		bs->primcap = bs->primcap == 0? 256: bs->primcap*2;
+		bs->primtab = erealloc(bs->primtab, bs->primcap*sizeof(*bs->primtab));
+	}
+	bs->primtab[bs->nprims] = *prim;
+
+	bbox = rectsubpt(bbox, fb->r.min);
+	for(ty = bbox.min.y/TILESIZE; ty <= (bbox.max.y-1)/TILESIZE; ty++)
+		for(tx = bbox.min.x/TILESIZE; tx <= (bbox.max.x-1)/TILESIZE; tx++){
+			bin = &bs->bins[ty*fb->ntilex + tx];
+			if(bin->nprims >= bin->cap){
+				bin->cap = bin->cap == 0? 64: bin->cap*2;
+				bin->prims = erealloc(bin->prims, bin->cap*sizeof(*bin->prims));
+			}
+			bin->prims[bin->nprims++] = bs->nprims;
 		}
+	bs->nprims++;
 }
 
-void
-shaderunit(void *arg)
+/*
+ * grab the next batch of n out of total items from a shared cursor.
+ * returns the index of the batch's first item, or -1 if none are left.
+ */
+static long
+grab(long *cursor, long n, long total)
 {
-	SUparams *params;
+	long b;
+
+	b = (ainc(cursor)-1)*n;
+	return b < total? b: -1;
+}
+
+/*
+ * run the vertex shader over the unique vertices, filling the
+ * post-transform buffer.
+ */
+static void
+transform(SUparams *params)
+{
+	Job *job;
+	Mesh *m;
 	VSparams vsp;
-	Memimage *frag;
-	OBJVertex *verts, *tverts, *nverts;	/* geometric, texture and normals vertices */
-	OBJIndexArray *idxtab;
-	OBJElem **ep;
-	Triangle3 t, st, nt;			/* world-, screen-space and normals triangles */
-	Triangle2 tt;				/* texture triangle */
-	Point3 n;				/* surface normal */
-	Point3 np0, np1, bc;
-	Triangle2 st₂;
+	Vertex *v;
+	float *p, *n, *uv;
+	long b, i;
 
-	params = arg;
+	job = params->job;
+	m = job->mesh;
 	vsp.su = params;
-	frag = rgb(DBlack);
-
-	threadsetname("shader unit #%d", params->id);
 
-	verts = model->vertdata[OBJVGeometric].verts;
-	tverts = model->vertdata[OBJVTexture].verts;
-	nverts = model->vertdata[OBJVNormal].verts;
-
-	for(ep = params->b; ep != params->e; ep++){
-		idxtab = &(*ep)->indextab[OBJVGeometric];
-
-		t.p0 = Pt3(verts[idxtab->indices[0]].x,verts[idxtab->indices[0]].y,verts[idxtab->indices[0]].z,verts[idxtab->indices[0]].w);
-		t.p1 = Pt3(verts[idxtab->indices[1]].x,verts[idxtab->indices[1]].y,verts[idxtab->indices[1]].z,verts[idxtab->indices[1]].w);
-		t.p2 = Pt3(verts[idxtab->indices[2]].x,verts[idxtab->indices[2]].y,verts[idxtab->indices[2]].z,verts[idxtab->indices[2]].w);
-
-		idxtab = &(*ep)->indextab[OBJVNormal];
-		if(idxtab->nindex == 3){
-			nt.p0 = Vec3(nverts[idxtab->indices[0]].i, nverts[idxtab->indices[0]].j, nverts[idxtab->indices[0]].k);
-			nt.p1 = Vec3(nverts[idxtab->indices[1]].i, nverts[idxtab->indices[1]].j, nverts[idxtab->indices[1]].k);
-			nt.p2 = Vec3(nverts[idxtab->indices[2]].i, nverts[idxtab->indices[2]].j, nverts[idxtab->indices[2]].k);
-			nt.p0 = normvec3(nt.p0);
-			nt.p1 = normvec3(nt.p1);
-			nt.p2 = normvec3(nt.p2);
-		}else{
-			n = normvec3(crossvec3(subpt3(t.p2, t.p0), subpt3(t.p1, t.p0)));
-			nt.p0 = nt.p1 = nt.p2 = mulpt3(n, -1);
+	while((b = grab(&job->nextvert, BATCHSIZE, m->nverts)) >= 0){
+		tracebegin("vertex batch");
+		for(i = b; i < min(b+BATCHSIZE, m->nverts); i++){
+			p = &m->pos[3*i];
+			n = &m->norm[3*i];
+			uv = &m->uv[3*i];
+			v = &job->verts[i];
+			v->p = Pt3(p[0], p[1], p[2], 1);
+			v->n = Vec3(n[0], n[1], n[2]);
+			v->uv = Pt2(uv[0], uv[1], uv[2]);
+			v->intensity = 0;
+			vsp.v = v;
+			v->p = params->vshader(&vsp);
 		}
-
-		vsp.p = &t.p0;
-		vsp.n = &nt.p0;
-		vsp.idx = 0;
-		st.p0 = params->vshader(&vsp);
-		vsp.p = &t.p1;
-		vsp.n = &nt.p1;
-		vsp.idx = 1;
-		st.p1 = params->vshader(&vsp);
-		vsp.p = &t.p2;
-		vsp.n = &nt.p2;
-		vsp.idx = 2;
-		st.p2 = params->vshader(&vsp);
-
-		st₂.p0 = Pt2(st.p0.x/st.p0.w, st.p0.y/st.p0.w, 1);
-		st₂.p1 = Pt2(st.p1.x/st.p1.w, st.p1.y/st.p1.w, 1);
-		st₂.p2 = Pt2(st.p2.x/st.p2.w, st.p2.y/st.p2.w, 1);
-		bc = barycoords(st₂, centroid(st₂));
-		np0 = centroid3((Triangle3){divpt3(st.p0, st.p0.w),divpt3(st.p1, st.p1.w),divpt3(st.p2, st.p2.w)});
-		np1 = Vec3(
-			nt.p0.x*bc.x + nt.p1.x*bc.y + nt.p2.x*bc.z,
-			nt.p0.y*bc.x + nt.p1.y*bc.y + nt.p2.y*bc.z,
-			nt.p0.z*bc.x + nt.p1.z*bc.y + nt.p2.z*bc.z);
-		np1 = addpt3(np0, mulpt3(np1, Dx(params->fb->r)/32));
-		triangle(params->fb->nb, Pt(st₂.p0.x,st₂.p0.y), Pt(st₂.p1.x,st₂.p1.y), Pt(st₂.p2.x,st₂.p2.y), red);
-		bresenham(params->fb->nb, Pt(np0.x,np0.y), Pt(np1.x,np1.y), green);
-
-		idxtab = &(*ep)->indextab[OBJVTexture];
-		if(modeltex != nil && idxtab->nindex == 3){
-			tt.p0 = Pt2(tverts[idxtab->indices[0]].u, tverts[idxtab->indices[0]].v, 1);
-			tt.p1 = Pt2(tverts[idxtab->indices[1]].u, tverts[idxtab->indices[1]].v, 1);
-			tt.p2 = Pt2(tverts[idxtab->indices[2]].u, tverts[idxtab->indices[2]].v, 1);
-		}else
-			memset(&tt, 0, sizeof tt);
-
-		rasterize(params, st, tt, frag);
-	}
-
-	freememimage(frag);
-	sendp(params->donec, nil);
-	free(params);
-	threadexits(nil);
+		traceend("vertex batch");
+	}
 }
 
 /*
- * it only processes quads for now.
+ * turn a triangle that needs no clipping into a primitive, and bin
+ * it. returns 0 if it got culled instead.
  */
 static int
-triangulate(OBJElem **newe, OBJElem *e)
-{
-	OBJIndexArray *newidxtab;
-	OBJIndexArray *idxtab;
-
-	idxtab = &e->indextab[OBJVGeometric];
-	newe[0] = emalloc(sizeof *newe[0]);
-	newe[0]->type = OBJEFace;
-	newidxtab = &newe[0]->indextab[OBJVGeometric];
-	newidxtab->nindex = 3;
-	newidxtab->indices = emalloc(newidxtab->nindex*sizeof(*newidxtab->indices));
-	newidxtab->indices[0] = idxtab->indices[0];
-	newidxtab->indices[1] = idxtab->indices[1];
-	newidxtab->indices[2] = idxtab->indices[2];
-	idxtab = &e->indextab[OBJVTexture];
-	newidxtab = &newe[0]->indextab[OBJVTexture];
-	newidxtab->nindex = 3;
-	newidxtab->indices = emalloc(newidxtab->nindex*sizeof(*newidxtab->indices));
-	newidxtab->indices[0] = idxtab->indices[0];
-	newidxtab->indices[1] = idxtab->indices[1];
-	newidxtab->indices[2] = idxtab->indices[2];
-	idxtab = &e->indextab[OBJVNormal];
-	newidxtab = &newe[0]->indextab[OBJVNormal];
-	newidxtab->nindex = 3;
-	newidxtab->indices = emalloc(newidxtab->nindex*sizeof(*newidxtab->indices));
-	newidxtab->indices[0] = idxtab->indices[0];
-	newidxtab->indices[1] = idxtab->indices[1];
-	newidxtab->indices[2] = idxtab->indices[2];
-
-	idxtab = &e->indextab[OBJVGeometric];
-	newe[1] = emalloc(sizeof *newe[1]);
-	newe[1]->type = OBJEFace;
-	newidxtab = &newe[1]->indextab[OBJVGeometric];
-	newidxtab->nindex = 3;
-	newidxtab->indices = emalloc(newidxtab->nindex*sizeof(*newidxtab->indices));
-	newidxtab->indices[0] = idxtab->indices[0];
-	newidxtab->indices[1] = idxtab->indices[2];
-	newidxtab->indices[2] = idxtab->indices[3];
-	idxtab = &e->indextab[OBJVTexture];
-	newidxtab = &newe[1]->indextab[OBJVTexture];
-	newidxtab->nindex = 3;
-	newidxtab->indices = emalloc(newidxtab->nindex*sizeof(*newidxtab->indices));
-	newidxtab->indices[0] = idxtab->indices[0];
-	newidxtab->indices[1] = idxtab->indices[2];
-	newidxtab->indices[2] = idxtab->indices[3];
-	idxtab = &e->indextab[OBJVNormal];
-	newidxtab = &newe[1]->indextab[OBJVNormal];
-	newidxtab->nindex = 3;
-	newidxtab->indices = emalloc(newidxtab->nindex*sizeof(*newidxtab->indices));
-	newidxtab->indices[0] = idxtab->indices[0];
-	newidxtab->indices[1] = idxtab->indices[2];
-	newidxtab->indices[2] = idxtab->indices[3];
-
-	return 2;
+assembleprim(SUparams *params, Vertex **v)
+{
+	Triangle3 st;				/* screen-space triangle */
+	Triangle2 tt;				/* texture triangle */
+	Primitive prim;
+	int i;
+
+	st.p0 = v[0]->p;
+	st.p1 = v[1]->p;
+	st.p2 = v[2]->p;
+
+	if(cull(&st, params->fb->r))
+		return 0;
+
+	if(modeltex != nil){
+		tt.p0 = v[0]->uv;
+		tt.p1 = v[1]->uv;
+		tt.p2 = v[2]->uv;
+	}else
+		memset(&tt, 0, sizeof tt);
+
+	prim.st = st;
+	prim.tt = tt;
+	for(i = 0; i < 3; i++)
+		prim.var_intensity[i] = v[i]->intensity;
+	binprim(params, &prim);
+	return 1;
+}
+
+/*
+ * gather the transformed vertices into primitives, clip them if
+ * they cross the near, far or guard-band planes, and bin them.
+ * clipped polygons are split back into triangles as fans.
+ */
+static void
+assemble(SUparams *params)
+{
+	Job *job;
+	Binset *bs;
+	Mesh *m;
+	u32int *t;
+	Vertex *v[3], poly[MAXCLIPVERTS], *fan[3];
+	int i, n, ntiles, c0, c1, c2, binned;
+	long b, e;
+
+	job = params->job;
+	bs = &params->binsets[job->slot];
+
+	ntiles = params->fb->ntilex*params->fb->ntiley;
+	if(bs->nbins < ntiles){
+		bs->bins = erealloc(bs->bins, ntiles*sizeof(*bs->bins));
+		memset(&bs->bins[bs->nbins], 0, (ntiles - bs->nbins)*sizeof(*bs->bins));
+		bs->nbins = ntiles;
+	}
+	for(i = 0; i < bs->nbins; i++)
+		bs->bins[i].nprims = 0;
+	bs->nprims = 0;
+	params->nculled = 0;
+
+	m = job->mesh;
+
+	while((b = grab(&job->nexttri, BATCHSIZE, m->ntris)) >= 0){
+		tracebegin("assembly batch");
+		for(e = b; e < min(b+BATCHSIZE, m->ntris); e++){
+			t = &m->tris[3*e];
+			v[0] = &job->verts[t[0]];
+			v[1] = &job->verts[t[1]];
+			v[2] = &job->verts[t[2]];
+
+			c0 = clipcode(v[0]->p, params->fb->r);
+			c1 = clipcode(v[1]->p, params->fb->r);
+			c2 = clipcode(v[2]->p, params->fb->r);
+			if((c0 | c1 | c2) == 0){
+				if(!assembleprim(params, v))
+					params->nculled++;
+				continue;
+			}
+			if((c0 & c1 & c2) != 0
+			|| (n = cliptriangle(poly, v, c0 | c1 | c2, params->fb->r)) == 0){
+				params->nculled++;
+				continue;
+			}
+			/* it's culled only if every piece of it is */
+			fan[0] = &poly[0];
+			binned = 0;
+			for(i = 1; i+1 < n; i++){
+				fan[1] = &poly[i];
+				fan[2] = &poly[i+1];
+				binned |= assembleprim(params, fan);
+			}
+			if(!binned)
+				params->nculled++;
+		}
+		traceend("assembly batch");
+	}
+}
+
+/*
+ * units grab tiles one at a time, and rasterize the contents
+ * of that tile's bins from all the units.
+ */
+static void
+raster(SUparams *params)
+{
+	Framebuf *fb;
+	SUparams *u;
+	Primitive *prim;
+	Bin *bin;
+	Rectangle tr;
+	ulong i, dirty;
+	uvlong t0;
+	long t;
+	int slot;
+
+	fb = params->fb;
+	slot = params->job->slot;
+	params->nfrags = 0;
+	params->shadetime = 0;
+	while((t = grab(&params->job->nexttile, 1, fb->ntilex*fb->ntiley)) >= 0){
+		tr = tilerect(fb, t);
+		tracebegin("tile");
+		if(fb->pending != nil && fb->pending[t]){
+			for(u = params->units; u < params->units+params->nunits; u++)
+				if(u->binsets[slot].bins[t].nprims > 0)
+					break;
+			if(u == params->units+params->nunits){
+				traceend("tile");
+				continue;
+			}
+			fbclearrect(fb, tr);
+			fb->pending[t] = 0;
+		}
+		/* timed per tile; per quad, the clock would cost more than the work */
+		t0 = nanosec();
+		for(u = params->units; u < params->units+params->nunits; u++){
+			bin = &u->binsets[slot].bins[t];
+			for(i = 0; i < bin->nprims; i++){
+				prim = &u->binsets[slot].primtab[bin->prims[i]];
+				/* skip it if it's behind everything already in the tile */
+				if(prim->zmax <= fb->tilez[t].zmin)
+					continue;
+				dirty = rasterize(params, prim, tr);
+				if(dirty != 0)
+					hizupdate(fb, t, dirty);
+			}
+		}
+		params->shadetime += nanosec() - t0;
+		traceend("tile");
+	}
 }
 
 void
-shade(Framebuf *fb, Shader *s)
-{
-	static int nparts, nworkers;
-	static OBJElem **elems = nil;
-	OBJElem *trielems[2];
-	int i, nelems;
-	uvlong time;
-	OBJObject *o;
-	OBJElem *e;
-	OBJIndexArray *idxtab;
+shaderunit(void *arg)
+{
 	SUparams *params;
-	Channel *donec;
+	Job *job;
+	uvlong t0, t;
 
-	if(elems == nil){
-		nelems = 0;
-		for(i = 0; i < nelem(model->objtab); i++)
-			for(o = model->objtab[i]; o != nil; o = o->next)
-				for(e = o->child; e != nil; e = e->next){
-					idxtab = &e->indextab[OBJVGeometric];
-					/* discard non-triangles */
-					if(e->type != OBJEFace || (idxtab->nindex != 3 && idxtab->nindex != 4))
-						continue;
-					if(idxtab->nindex == 4){
-						triangulate(trielems, e);
-						nelems += 2;
-						elems = erealloc(elems, nelems*sizeof(*elems));
-						elems[nelems-2] = trielems[0];
-						elems[nelems-1] = trielems[1];
-					}else{
-						elems = erealloc(elems, ++nelems*sizeof(*elems));
-						elems[nelems-1] = e;
-					}
-				}
-		if(nelems < nprocs){
-			nworkers = nelems;
-			nparts = 1;
-		}else{
-			nworkers = nprocs;
-			nparts = nelems/nprocs;
+	params = arg;
+
+	threadsetname("shader unit #%d", params->id);
+
+	for(;;){
+		job = recvp(params->workc);
+		params->job = job;
+		params->fb = job->fb;
+		params->uni_time = job->uni_time;
+		memmove(params->uni_rot, job->uni_rot, sizeof(Matrix3));
+		memmove(params->uni_mv, job->uni_mv, sizeof(Matrix3));
+		memmove(params->uni_mvp, job->uni_mvp, sizeof(Matrix3));
+		params->vshader = job->vshader;
+		params->fshader = job->fshader;
+
+		switch(job->stage){
+		case SUVertex:
+			t0 = nanosec();
+			transform(params);
+			updatestats(&params->stats[StVertex], nanosec() - t0);
+			break;
+		case SUAssembly:
+			t0 = nanosec();
+			assemble(params);
+			updatestats(&params->stats[StAssembly], nanosec() - t0);
+			break;
+		case SURaster:
+			t0 = nanosec();
+			raster(params);
+			t = nanosec() - t0;
+			updatestats(&params->stats[StTiles], t - params->shadetime);
+			updatestats(&params->stats[StShade], params->shadetime);
+			break;
+		}
+		sendp(job->donec, nil);
+	}
+}
+
+/*
+ * draw the enabled debug overlays into the fb's own buffer, once
+ * the job is rasterized. it runs on the renderer proc, so it
+ * only ever stores words into nb and leaves memdraw to the main
+ * proc. primitives are drawn as binned, i.e. clipped and culled,
+ * but normals come straight from the mesh.
+ */
+static void
+drawoverlays(Framebuf *fb, SUparams *units, int nunits, Job *job)
+{
+	SUparams *u;
+	Binset *bs;
+	Primitive *prim;
+	Triangle2 st₂;
+	Triangle3 st, nt;
+	Point3 np0, np1, bc;
+	Rectangle r;
+	u32int *t;
+	ulong i;
+
+	memset(byteaddr(fb->nb, fb->r.min), 0, bytesperline(fb->r, fb->nb->depth)*Dy(fb->r));
+
+	for(u = units; u < units+nunits; u++){
+		bs = &u->binsets[job->slot];
+		for(i = 0; i < bs->nprims; i++){
+			prim = &bs->primtab[i];
+			if(showoverlays & OWireframe){
+				st = prim->st;
+				triangle(fb->nb,
+					Pt(st.p0.x/st.p0.w, st.p0.y/st.p0.w),
+					Pt(st.p1.x/st.p1.w, st.p1.y/st.p1.w),
+					Pt(st.p2.x/st.p2.w, st.p2.y/st.p2.w), DRed);
+			}
+			if(showoverlays & OBBoxes){
+				r = prim->bbox;
+				r.max = subpt(r.max, Pt(1,1));
+				bresenham(fb->nb, r.min, Pt(r.max.x,r.min.y), DBlue);
+				bresenham(fb->nb, Pt(r.max.x,r.min.y), r.max, DBlue);
+				bresenham(fb->nb, r.max, Pt(r.min.x,r.max.y), DBlue);
+				bresenham(fb->nb, Pt(r.min.x,r.max.y), r.min, DBlue);
+			}
 		}
 	}
-	time = nanosec();
 
-	donec = chancreate(sizeof(void*), 0);
+	if(showoverlays & ONormals)
+		for(i = 0; i < job->mesh->ntris; i++){
+			t = &job->mesh->tris[3*i];
+			st.p0 = job->verts[t[0]].p;
+			st.p1 = job->verts[t[1]].p;
+			st.p2 = job->verts[t[2]].p;
+			/* unclipped, so stay clear of the camera plane */
+			if(st.p0.w <= 0 || st.p1.w <= 0 || st.p2.w <= 0
+			|| cull(&st, fb->r))
+				continue;
+			nt.p0 = job->verts[t[0]].n;
+			nt.p1 = job->verts[t[1]].n;
+			nt.p2 = job->verts[t[2]].n;
+			st₂.p0 = Pt2(st.p0.x/st.p0.w, st.p0.y/st.p0.w, 1);
+			st₂.p1 = Pt2(st.p1.x/st.p1.w, st.p1.y/st.p1.w, 1);
+			st₂.p2 = Pt2(st.p2.x/st.p2.w, st.p2.y/st.p2.w, 1);
+			bc = barycoords(st₂, centroid(st₂));
+			np0 = centroid3((Triangle3){divpt3(st.p0, st.p0.w),divpt3(st.p1, st.p1.w),divpt3(st.p2, st.p2.w)});
+			np1 = Vec3(
+				nt.p0.x*bc.x + nt.p1.x*bc.y + nt.p2.x*bc.z,
+				nt.p0.y*bc.x + nt.p1.y*bc.y + nt.p2.y*bc.z,
+				nt.p0.z*bc.x + nt.p1.z*bc.y + nt.p2.z*bc.z);
+			np1 = addpt3(np0, mulpt3(np1, Dx(fb->r)/32));
+			bresenham(fb->nb, Pt(np0.x,np0.y), Pt(np1.x,np1.y), DGreen);
+		}
+}
+
+static SUparams *units;		/* the shader units */
+static int nworkers;
+static Job jobs[NJOBSLOTS];
 
+/*
+ * the shader units live for as long as the program does, and
+ * so do the jobs, one per frame that can be in flight.
+ */
+static void
+initunits(void)
+{
+	SUparams *params;
+	Job *job;
+	int i;
+
+	nworkers = nprocs;
+	for(i = 0; i < NJOBSLOTS; i++){
+		job = &jobs[i];
+		job->mesh = mesh;
+		job->verts = emalloc(mesh->nverts*sizeof(*job->verts));
+		job->slot = i;
+		/* units mustn't block on it before moving on to the other job */
+		job->donec = chancreate(sizeof(void*), nworkers);
+	}
+
+	units = emalloc(nworkers*sizeof(*units));
+	memset(units, 0, nworkers*sizeof(*units));
 	for(i = 0; i < nworkers; i++){
-		params = emalloc(sizeof *params);
-		params->fb = fb;
-		params->b = &elems[i*nparts];
-		params->e = params->b + nparts;
+		params = &units[i];
 		params->id = i;
-		params->donec = donec;
-		params->uni_time = time;
-		params->vshader = s->vshader;
-		params->fshader = s->fshader;
+		params->workc = chancreate(sizeof(Job*), NJOBSLOTS);
+		params->units = units;
+		params->nunits = nworkers;
 		proccreate(shaderunit, params, mainstacksize);
-//		fprint(2, "spawned su %d for elems [%d, %d)\n", params->id, i*nparts, i*nparts+nparts);
 	}
+}
+
+/*
+ * set up the uniforms to render a frame with s at the given time.
+ */
+static void
+setupjob(Job *job, Shader *s, uvlong time)
+{
+	Matrix3 S, MV, MVP, R;
+	double α;
+
+	identity3(S);
+	S[0][0] = S[1][1] = S[2][2] = scale;
+	identity3(MV);
+	mulm3(MV, rota);
+	mulm3(MV, S);
+	identity3(MVP);
+	mulm3(MVP, view);
+	mulm3(MVP, MV);
+	α = θ+fmod(ω*time/1e9, 2*PI);
+	identity3(R);
+	R[0][0] = R[2][2] = cos(α);
+	R[0][2] = sin(α);
+	R[2][0] = -sin(α);
+
+	job->uni_time = time;
+	memmove(job->uni_rot, R, sizeof(Matrix3));
+	memmove(job->uni_mv, MV, sizeof(Matrix3));
+	memmove(job->uni_mvp, MVP, sizeof(Matrix3));
+	job->vshader = s->vshader;
+	job->fshader = s->fshader;
+}
+
+/*
+ * queue a stage of the job on every unit. each unit gets to it
+ * once it's done with whatever it had queued before.
+ */
+static void
+startstage(Job *job, int stage)
+{
+	int i;
+
+	job->stage = stage;
+	switch(stage){
+	case SUVertex:
+		job->nextvert = 0;
+		break;
+	case SUAssembly:
+		job->nexttri = 0;
+		break;
+	case SURaster:
+		job->nexttile = 0;
+		break;
+	}
+	for(i = 0; i < nworkers; i++)
+		sendp(units[i].workc, job);
+}
+
+/*
+ * the time the slowest unit spent on its last run of a stage.
+ */
+static uvlong
+slowest(int stage)
+{
+	uvlong t;
+	int i;
+
+	t = 0;
+	for(i = 0; i < nworkers; i++)
+		if(units[i].stats[stage].v > t)
+			t = units[i].stats[stage].v;
+	return t;
+}
+
+/*
+ * wait for every unit to finish the job's stage, and gather its
+ * stats. a frame's stage takes as long as its slowest unit was
+ * busy with it. the wall clock would be no good: a stage can sit
+ * queued behind the previous frame's rasterization.
+ */
+static void
+waitstage(Job *job)
+{
+	int i;
+
+	for(i = 0; i < nworkers; i++)
+		recvp(job->donec);
+
+	switch(job->stage){
+	case SUVertex:
+		updatestats(&stagestats[StVertex], slowest(StVertex));
+		break;
+	case SUAssembly:
+		updatestats(&stagestats[StAssembly], slowest(StAssembly));
+		nculled = 0;
+		for(i = 0; i < nworkers; i++)
+			nculled += units[i].nculled;
+		break;
+	case SURaster:
+		updatestats(&stagestats[StTiles], slowest(StTiles));
+		updatestats(&stagestats[StShade], slowest(StShade));
+		nfrags = 0;
+		for(i = 0; i < nworkers; i++)
+			nfrags += units[i].nfrags;
+		break;
+	}
+}
+
+/*
+ * render a frame into fb from start to finish.
+ */
+void
+shade(Framebuf *fb, Shader *s, uvlong time)
+{
+	Job *job;
+
+	if(units == nil)
+		initunits();
 
-	while(i--)
-		recvp(donec);
-	chanfree(donec);
+	job = &jobs[0];
+	job->fb = fb;
+	setupjob(job, s, time);
+
+	/* sort-middle: every primitive is binned before any tile gets rasterized */
+	startstage(job, SUVertex);
+	waitstage(job);
+	startstage(job, SUAssembly);
+	waitstage(job);
+	startstage(job, SURaster);
+	waitstage(job);
+
+	if(showoverlays)
+		drawoverlays(fb, units, nworkers, job);
 }
 
-Memimage *
+ulong
 triangleshader(FSparams *sp)
 {
 	Triangle2 t;
@@ -532,21 +1146,20 @@ triangleshader(FSparams *sp)
 		max(max(t.p0.x, t.p1.x), t.p2.x), max(max(t.p0.y, t.p1.y), t.p2.y)
 	);
 	if(!ptinrect(sp->p, bbox))
-		return nil;
+		return 0;
 
 	bc = barycoords(t, Pt2(sp->p.x,sp->p.y,1));
 	if(bc.x < 0 || bc.y < 0 || bc.z < 0)
-		return nil;
+		return 0;
 
 	cbuf[0] = 0xFF;
 	cbuf[1] = 0xFF*bc.z;
 	cbuf[2] = 0xFF*bc.y;
 	cbuf[3] = 0xFF*bc.x;
-	memfillcolor(sp->frag, *(ulong*)cbuf);
-	return sp->frag;
+	return *(ulong*)cbuf;
 }
 
-Memimage *
+ulong
 circleshader(FSparams *sp)
 {
 	Point2 uv;
@@ -561,19 +1174,18 @@ circleshader(FSparams *sp)
 	d = vec2len(subpt2(uv, Vec2(0.5,0.5)));
 
 	if(d > r + r*0.05 || d < r - r*0.05)
-		return nil;
+		return 0;
 
 	cbuf[0] = 0xFF;
 	cbuf[1] = 0;
 	cbuf[2] = 0xFF*uv.y;
 	cbuf[3] = 0xFF*uv.x;
 
-	memfillcolor(sp->frag, *(ulong*)cbuf);
-	return sp->frag;
+	return *(ulong*)cbuf;
 }
 
 /* some shaping functions from The Book of Shaders, Chapter 5 */
-Memimage *
+ulong
 sfshader(FSparams *sp)
 {
 	Point2 uv;
@@ -597,11 +1209,10 @@ sfshader(FSparams *sp)
 	cbuf[2] = 0xFF*flerp(y, 1, pct);
 	cbuf[3] = 0xFF*flerp(y, 0, pct);
 
-	memfillcolor(sp->frag, *(ulong*)cbuf);
-	return sp->frag;
+	return *(ulong*)cbuf;
 }
 
-Memimage *
+ulong
 boxshader(FSparams *sp)
 {
 	Point2 uv, p;
@@ -619,42 +1230,26 @@ boxshader(FSparams *sp)
 	p.y = fmax(p.y, 0);
 
 	if(vec2len(p) > 0)
-		return nil;
+		return 0;
 
 	cbuf[0] = 0xFF;
 	cbuf[1] = 0xFF*smoothstep(0,1,uv.x+uv.y);
 	cbuf[2] = 0xFF*uv.y;
 	cbuf[3] = 0xFF*uv.x;
 
-	memfillcolor(sp->frag, *(ulong*)cbuf);
-	return sp->frag;
+	return *(ulong*)cbuf;
 }
 
 Point3
 ivshader(VSparams *sp)
 {
-	Matrix3 M, V, S = {
-		scale, 0, 0, 0,
-		0, scale, 0, 0,
-		0, 0, scale, 0,
-		0, 0, 0, 1,
-	};
-
-	identity3(M);
-	identity3(V);
-	mulm3(M, rota);
-	mulm3(M, S);
-	mulm3(V, view);
-	mulm3(V, M);
-
-	return xform3(*sp->p, V);
+	return xform3(sp->v->p, sp->su->uni_mvp);
 }
 
-Memimage *
+ulong
 identshader(FSparams *sp)
 {
-	memfillcolor(sp->frag, *(ulong*)sp->cbuf);
-	return sp->frag;
+	return texcolor(sp);
 }
 
 Shader shadertab[] = {
@@ -681,15 +1276,63 @@ void
 drawstats(void)
 {
 	char buf[128];
+	int i, n, y;
 
 	/* fps stats hold latency, so max period is min frequency */
 	snprint(buf, sizeof buf, "FPS %.0f/%.0f/%.0f/%.0f", !fps.max? 0: 1e9/fps.max, !fps.avg? 0: 1e9/fps.avg, !fps.min? 0: 1e9/fps.min, !fps.v? 0: 1e9/fps.v);
 	stringbg(screen, Pt(screen->r.min.x+10,screen->r.max.y-20), display->black, ZP, font, buf, display->white, ZP);
+	snprint(buf, sizeof buf, "culled %lud/%lud", nculled, mesh->ntris);
+	stringbg(screen, Pt(screen->r.min.x+10,screen->r.max.y-40), display->black, ZP, font, buf, display->white, ZP);
+	if(!showtimings)
+		return;
+
+	/* avg/p99 per stage, and every unit's last raster, to spot stragglers */
+	y = screen->r.max.y-60;
+	for(i = 0; i < NSTAGES; i++, y -= 20){
+		snprint(buf, sizeof buf, "%s %.2f/%.2fms", stagenames[i],
+			stagestats[i].avg/1e6, statpct(&stagestats[i], 0.99)/1e6);
+		stringbg(screen, Pt(screen->r.min.x+10,y), display->black, ZP, font, buf, display->white, ZP);
+	}
+	n = snprint(buf, sizeof buf, "units");
+	for(i = 0; i < nworkers && n < sizeof buf; i++)
+		n += snprint(buf+n, sizeof buf - n, " %.2f",
+			(units[i].stats[StTiles].v + units[i].stats[StShade].v)/1e6);
+	stringbg(screen, Pt(screen->r.min.x+10,y), display->black, ZP, font, buf, display->white, ZP);
+}
+
+static void
+dumpstat(char *name, Stats *s)
+{
+	fprint(2, "%-16s n %llud min %llud avg %llud p50 %llud p99 %llud max %llud\n",
+		name, s->n, s->min, s->avg, statpct(s, 0.5), statpct(s, 0.99), s->max);
+}
+
+/*
+ * print the stage timings to stderr, for the frames as a whole
+ * and for each shader unit. times are in ns.
+ */
+void
+dumpstats(void)
+{
+	char name[32];
+	int i, j;
+
+	for(i = 0; i < NSTAGES; i++)
+		dumpstat(stagenames[i], &stagestats[i]);
+	for(i = 0; i < nworkers; i++)
+		for(j = StVertex; j <= StShade; j++){
+			snprint(name, sizeof name, "%d/%s", i, stagenames[j]);
+			dumpstat(name, &units[i].stats[j]);
+		}
 }
 
 void
 redraw(void)
 {
+	uvlong t0;
+
+	tracebegin("present");
+	t0 = nanosec();
 	memfillcolor(screenfb, 0x888888FF);
 	fbctl->draw(fbctl, screenfb, showzbuffer);
 
@@ -698,46 +1341,283 @@ redraw(void)
 	drawstats();
 	flushimage(display, 1);
 	unlockdisplay(display);
+	updatestats(&stagestats[StPresent], nanosec()-t0);
+	traceend("present");
 }
 
-void
-render(Shader *s)
+static void
+clearback(void)
 {
-	uvlong t0, t1;
-
-	fbctl->reset(fbctl);
+	uvlong t0;
 
 	t0 = nanosec();
-	shade(fbctl->fb[fbctl->idx^1], s);	/* address the back buffer */
-	t1 = nanosec();
-	updatestats(&fps, t1-t0);
+	fbctl->reset(fbctl);
+	updatestats(&stagestats[StClear], nanosec()-t0);
 }
 
+/*
+ * render frames for as long as the program runs, two at a time:
+ * the geometry of the next frame is queued right behind the
+ * rasterization of the current one, so units done with their
+ * tiles go on to it instead of waiting for the stragglers. only
+ * rasterization needs the back buffer, and by the time the next
+ * frame gets to it the current one has been swapped out and the
+ * new back buffer cleared, while the units were busy.
+ */
 void
 renderer(void *arg)
 {
+	Shader *s;
+	Job *cur, *next;
+	uvlong t, lastswap;
+	int n;
+
+	s = arg;
 	threadsetname("renderer");
 
-	for(;;){
-		render((Shader*)arg);
+	if(units == nil)
+		initunits();
+
+	clearback();
+	cur = &jobs[0];
+	cur->fb = fbctl->getbackfb(fbctl);
+	setupjob(cur, s, nanosec());
+	startstage(cur, SUVertex);
+	waitstage(cur);
+	startstage(cur, SUAssembly);
+	waitstage(cur);
+	lastswap = nanosec();
+
+	for(n = 1;; n++){
+		/* nothing is queued on the units in between frames */
+		if(nbrecvp(stopc) != nil)
+			threadexits(nil);
+
+		tracebegin("frame");
+		cur->fb = fbctl->getbackfb(fbctl);
+		startstage(cur, SURaster);
+
+		next = &jobs[n%NJOBSLOTS];
+		next->fb = cur->fb;
+		setupjob(next, s, nanosec());
+		startstage(next, SUVertex);
+
+		waitstage(cur);
+		if(showoverlays)
+			drawoverlays(cur->fb, units, nworkers, cur);
 		fbctl->swap(fbctl);
 		nbsendp(drawc, nil);
+		t = nanosec();
+		updatestats(&fps, t-lastswap);
+		lastswap = t;
+		traceend("frame");
+
+		clearback();
+		waitstage(next);
+		startstage(next, SUAssembly);
+		waitstage(next);
+		cur = next;
 	}
 }
 
+typedef struct Writer Writer;
+struct Writer
+{
+	char *out;		/* path format, or "-" for stdout */
+	Channel *framec;	/* frames to write; nil when done */
+	Channel *donec;
+};
+
+/*
+ * count the %d verbs in an output path format, or -1 if it has
+ * any other. those may carry flags and a width, e.g. %04d.
+ */
+static int
+outverbs(char *fmt)
+{
+	int n;
+
+	n = 0;
+	while((fmt = strchr(fmt, '%')) != nil){
+		fmt++;
+		if(*fmt == '%'){
+			fmt++;
+			continue;
+		}
+		fmt += strspn(fmt, "-+ #0123456789");
+		if(*fmt++ != 'd')
+			return -1;
+		n++;
+	}
+	return n;
+}
+
+/*
+ * encode and write frames as they come. frame n goes to the
+ * file named after out with n as the argument, so it may
+ * carry a %d verb; see outverbs. "-" streams them to stdout
+ * as images.
+ */
+static void
+writer(void *arg)
+{
+	Writer *w;
+	Memimage *frame;
+	char *path;
+	int n;
+
+	w = arg;
+	threadsetname("writer");
+
+	for(n = 0; (frame = recvp(w->framec)) != nil; n++){
+		if(strcmp(w->out, "-") == 0){
+			if(writememimage(1, frame) < 0)
+				sysfatal("writememimage: %r");
+		}else{
+			path = smprint(w->out, n);
+			if(path == nil)
+				sysfatal("smprint: %r");
+			if(writeframe(path, frame) < 0)
+				sysfatal("writeframe: %s: %r", path);
+			free(path);
+		}
+		freememimage(frame);
+	}
+	sendp(w->donec, nil);
+}
+
+/*
+ * render nframes frames dt nanoseconds apart, with no display,
+ * handing every one of them to the writer.
+ */
+void
+headless(Shader *s, char *out, int nframes, uvlong dt)
+{
+	Writer w;
+	Memimage *frame;
+	uvlong t0, t1;
+	int i;
+
+	w.out = out;
+	/* let the renderer get a few frames ahead */
+	w.framec = chancreate(sizeof(Memimage*), 4);
+	w.donec = chancreate(sizeof(void*), 0);
+	proccreate(writer, &w, mainstacksize);
+
+	for(i = 0; i < nframes; i++){
+		tracebegin("frame");
+		t0 = nanosec();
+		fbctl->reset(fbctl);
+		t1 = nanosec();
+		updatestats(&stagestats[StClear], t1-t0);
+		shade(fbctl->getbackfb(fbctl), s, i*dt);
+		t0 = nanosec();
+		updatestats(&fps, t0-t1);
+		traceend("frame");
+		tracebegin("present");
+		fbctl->swap(fbctl);
+
+		frame = eallocmemimage(fbctl->getfb(fbctl)->r, RGBA32);
+		memfillcolor(frame, DTransparent);
+		fbctl->draw(fbctl, frame, showzbuffer);
+		updatestats(&stagestats[StPresent], nanosec()-t0);
+		traceend("present");
+		sendp(w.framec, frame);
+	}
+	sendp(w.framec, nil);
+	recvp(w.donec);
+}
+
+static int
+cmpuvlong(void *a, void *b)
+{
+	uvlong x, y;
+
+	x = *(uvlong*)a;
+	y = *(uvlong*)b;
+	return x < y? -1: x > y;
+}
+
+/*
+ * time nframes frames with every shader, always at time 0 so
+ * the model and camera stay put and runs are comparable. one
+ * line of key=value pairs per shader goes to stdout.
+ */
+void
+bench(char *mdlpath, int nframes)
+{
+	Shader *s;
+	uvlong *ft, t0, acc;
+	vlong tfrags;
+	int i;
+
+	ft = emalloc(nframes*sizeof(*ft));
+	for(s = shadertab; s < shadertab+nelem(shadertab); s++){
+		/* warm up: the first frame allocates the bins */
+		fbctl->reset(fbctl);
+		shade(fbctl->getbackfb(fbctl), s, 0);
+
+		acc = 0;
+		tfrags = 0;
+		for(i = 0; i < nframes; i++){
+			t0 = nanosec();
+			fbctl->reset(fbctl);
+			shade(fbctl->getbackfb(fbctl), s, 0);
+			ft[i] = nanosec() - t0;
+			acc += ft[i];
+			tfrags += nfrags;
+		}
+		qsort(ft, nframes, sizeof(*ft), cmpuvlong);
+		if(acc == 0)
+			acc = 1;
+
+		print("model=%s shader=%s w=%d h=%d nprocs=%d frames=%d "
+			"min=%llud avg=%llud p99=%llud tris/s=%.0f frags/s=%.0f\n",
+			mdlpath, s->name, Dx(fbctl->getfb(fbctl)->r), Dy(fbctl->getfb(fbctl)->r), nprocs, nframes,
+			ft[0], acc/nframes, ft[(nframes*99+99)/100-1],
+			(double)mesh->ntris*nframes*1e9/acc, (double)tfrags*1e9/acc);
+	}
+	free(ft);
+}
+
+/*
+ * report what was measured and leave. the renderer gets stopped
+ * first, so the shader units are idle by the time we get to the
+ * stats and the trace.
+ */
+void
+quit(void)
+{
+	if(stopc != nil)
+		sendp(stopc, stopc);
+	dumpstats();
+	if(tracing && writetrace(tracepath) < 0)
+		fprint(2, "writetrace: %r\n");
+	threadexitsall(nil);
+}
+
 static char *
 genrmbmenuitem(int idx)
 {
 	enum {
 		TOGGLEZBUF,
+		TOGGLEWIRE,
 		TOGGLENORM,
+		TOGGLEBBOX,
+		TOGGLETIMES,
 	};
 
 	switch(idx){
 	case TOGGLEZBUF:
 		return showzbuffer? "hide z-buffer": "show z-buffer";
+	case TOGGLEWIRE:
+		return showoverlays & OWireframe? "hide wireframe": "show wireframe";
 	case TOGGLENORM:
-		return shownormals? "hide normals": "show normals";
+		return showoverlays & ONormals? "hide normals": "show normals";
+	case TOGGLEBBOX:
+		return showoverlays & OBBoxes? "hide bboxes": "show bboxes";
+	case TOGGLETIMES:
+		return showtimings? "hide timings": "show timings";
 	}
 	return nil;
 }
@@ -747,7 +1627,10 @@ rmb(Mousectl *mc, Keyboardctl *)
 {
 	enum {
 		TOGGLEZBUF,
+		TOGGLEWIRE,
 		TOGGLENORM,
+		TOGGLEBBOX,
+		TOGGLETIMES,
 	};
 	static Menu menu = { .gen = genrmbmenuitem };
 
@@ -755,8 +1638,17 @@ rmb(Mousectl *mc, Keyboardctl *)
 	case TOGGLEZBUF:
 		showzbuffer ^= 1;
 		break;
+	case TOGGLEWIRE:
+		showoverlays ^= OWireframe;
+		break;
 	case TOGGLENORM:
-		shownormals ^= 1;
+		showoverlays ^= ONormals;
+		break;
+	case TOGGLEBBOX:
+		showoverlays ^= OBBoxes;
+		break;
+	case TOGGLETIMES:
+		showtimings ^= 1;
 		break;
 	}
 	nbsendp(drawc, nil);
@@ -765,10 +1657,14 @@ rmb(Mousectl *mc, Keyboardctl *)
 void
 lmb(Mousectl *mc, Keyboardctl *)
 {
+	Framebuf *fb;
 	Point p;
 
+	fb = fbctl->getfb(fbctl);
 	p = subpt(mc->xy, screen->r.min);
-	fprint(2, "p %P z %g\n", p, fbctl->fb[fbctl->idx]->zbuf[p.x + p.y*Dx(fbctl->fb[fbctl->idx]->r)]);
+	if(!ptinrect(p, fb->r))
+		return;
+	fprint(2, "p %P z %g\n", p, zget(fb, p));
 }
 
 void
@@ -790,7 +1686,7 @@ key(Rune r)
 	switch(r){
 	case Kdel:
 	case 'q':
-		threadexitsall(nil);
+		quit();
 	case 'w':
 	case 's':
 		camera.z += r == 'w'? -1: 1;
@@ -821,7 +1717,7 @@ key(Rune r)
 void
 usage(void)
 {
-	fprint(2, "usage: %s [-n nprocs] [-m objfile] [-t texfile] [-a yrotangle] [-s shader] [-w width] [-h height]\n", argv0);
+	fprint(2, "usage: %s [-n nprocs] [-m objfile] [-t texfile] [-f nearest|bilinear|trilinear] [-l linear|blocked] [-a yrotangle] [-s shader] [-c none|back|front] [-z float|d24] [-L] [-T tracefile] [-o out [-d ms] | -b] [-N nframes] [-w width] [-h height]\n", argv0);
 	exits("usage");
 }
 
@@ -832,14 +1728,25 @@ threadmain(int argc, char *argv[])
 	Keyboardctl *kc;
 	Rune r;
 	Shader *s;
-	char *mdlpath, *texpath, *p;
-	char *sname;
-	int fbw, fbh;
+	char *mdlpath, *texpath;
+	char *sname, *fname, *lname, *cname, *zname, *out;
+	int fbw, fbh, zfmt, lazyclear, nframes, benchmode, n;
+	double dt;
+	Rectangle fbr;
 
 	GEOMfmtinstall();
 	mdlpath = "mdl/quad.obj";
 	texpath = nil;
 	sname = "gouraud";
+	fname = "nearest";
+	cname = "back";
+	zname = "float";
+	lazyclear = 0;
+	out = nil;
+	benchmode = 0;
+	nframes = 1;
+	dt = 1000.0/60;
+	lname = "linear";
 	fbw = 200;
 	fbh = 200;
 	ω = 20*DEG;
@@ -854,6 +1761,37 @@ threadmain(int argc, char *argv[])
 	case 't':
 		texpath = EARGF(usage());
 		break;
+	case 'f':
+		fname = EARGF(usage());
+		break;
+	case 'l':
+		lname = EARGF(usage());
+		break;
+	case 'c':
+		cname = EARGF(usage());
+		break;
+	case 'z':
+		zname = EARGF(usage());
+		break;
+	case 'L':
+		lazyclear++;
+		break;
+	case 'o':
+		out = EARGF(usage());
+		break;
+	case 'b':
+		benchmode++;
+		break;
+	case 'T':
+		tracepath = EARGF(usage());
+		tracing++;
+		break;
+	case 'N':
+		nframes = strtoul(EARGF(usage()), nil, 10);
+		break;
+	case 'd':
+		dt = strtod(EARGF(usage()), nil);
+		break;
 	case 'a':
 		θ = strtod(EARGF(usage()), nil)*DEG;
 		break;
@@ -871,67 +1809,94 @@ threadmain(int argc, char *argv[])
 		break;
 	default: usage();
 	}ARGEND;
-	if(argc != 0)
+	if(argc != 0 || nframes < 1)
 		usage();
+	if(out != nil && strcmp(out, "-") != 0
+	&& ((n = outverbs(out)) < 0 || n > 1 || n == 0 && nframes > 1))
+		sysfatal("-o %s: want a single %%d for the frame number", out);
 
 	if(nprocs < 1)
 		nprocs = strtoul(getenv("NPROC"), nil, 10);
 
 	if((s = getshader(sname)) == nil)
 		sysfatal("couldn't find %s shader", sname);
-
-	if((model = objparse(mdlpath)) == nil)
-		sysfatal("objparse: %r");
+	if(strcmp(cname, "none") == 0)
+		cullmode = CullNone;
+	else if(strcmp(cname, "back") == 0)
+		cullmode = CullBack;
+	else if(strcmp(cname, "front") == 0)
+		cullmode = CullFront;
+	else
+		sysfatal("unknown cull mode %s", cname);
+	if(strcmp(zname, "float") == 0)
+		zfmt = ZFloat;
+	else if(strcmp(zname, "d24") == 0)
+		zfmt = ZD24;
+	else
+		sysfatal("unknown depth format %s", zname);
+
+	if((mesh = loadmesh(mdlpath)) == nil)
+		sysfatal("loadmesh: %r");
 	if(texpath != nil){
-		if((p = strrchr(texpath, '/')) == nil)
-			p = texpath;
-		p = strchr(p, '.');
-		if(p == nil)
-			sysfatal("unknown image file");
-		if(strcmp(++p, "tga") == 0 && (modeltex = readtga(texpath)) == nil)
-			sysfatal("readtga: %r");
-		else if(strcmp(p, "png") == 0 && (modeltex = readpng(texpath)) == nil)
-			sysfatal("readpng: %r");
-	}
-
-	{
-		int i, nv[OBJNVERT], nf;
-		OBJObject *o;
-		OBJElem *e;
-
-		nf = 0;
-		memset(nv, 0, sizeof nv);
-		for(i = 0; i < OBJNVERT; i++) nv[i] += model->vertdata[i].nvert;
-		for(i = 0; i < OBJHTSIZE; i++) if((o = model->objtab[i]) != nil)
-		for(e = o->child; e != nil; e = e->next) if(e->type == OBJEFace) nf++;
-		fprint(2, "v %d vn %d vt %d f %d\n", nv[OBJVGeometric], nv[OBJVNormal], nv[OBJVTexture], nf);
-	}
-
-	snprint(winspec, sizeof winspec, "-dx %d -dy %d", fbw, fbh);
-	if(newwindow(winspec) < 0)
-		sysfatal("newwindow: %r");
-	if(initdraw(nil, nil, "tinyrend") < 0)
-		sysfatal("initdraw: %r");
-	if(memimageinit() != 0)
-		sysfatal("memimageinit: %r");
-	if((mc = initmouse(nil, screen)) == nil)
-		sysfatal("initmouse: %r");
-	if((kc = initkeyboard(nil)) == nil)
-		sysfatal("initkeyboard: %r");
-
-	screenfb = eallocmemimage(rectsubpt(screen->r, screen->r.min), screen->chan);
-	fbctl = newfbctl(screenfb->r);
-	red = rgb(DRed);
-	green = rgb(DGreen);
-	blue = rgb(DBlue);
-
-	viewport(screenfb->r);
+		if(strcmp(lname, "blocked") == 0)
+			modeltex = readtexture(texpath, TBlocked);
+		else if(strcmp(lname, "linear") == 0)
+			modeltex = readtexture(texpath, TLinear);
+		else
+			sysfatal("unknown texture layout %s", lname);
+		if(modeltex == nil)
+			sysfatal("readtexture: %r");
+		if(strcmp(fname, "bilinear") == 0)
+			modeltex->filter = TBilinear;
+		else if(strcmp(fname, "trilinear") == 0)
+			modeltex->filter = TTrilinear;
+		else if(strcmp(fname, "nearest") != 0)
+			sysfatal("unknown texture filter %s", fname);
+	}
+
+	/* the vertex cache hits are the corners that don't need shading */
+	fprint(2, "mesh: %lud verts %lud tris, vertex cache %.1f%% hits\n", mesh->nverts, mesh->ntris,
+		mesh->ntris == 0? 0: 100.0*(3*mesh->ntris - mesh->nverts)/(3*mesh->ntris));
+
+	if(out == nil && !benchmode){
+		snprint(winspec, sizeof winspec, "-dx %d -dy %d", fbw, fbh);
+		if(newwindow(winspec) < 0)
+			sysfatal("newwindow: %r");
+		if(initdraw(nil, nil, "tinyrend") < 0)
+			sysfatal("initdraw: %r");
+		if(memimageinit() != 0)
+			sysfatal("memimageinit: %r");
+		if((mc = initmouse(nil, screen)) == nil)
+			sysfatal("initmouse: %r");
+		if((kc = initkeyboard(nil)) == nil)
+			sysfatal("initkeyboard: %r");
+		screenfb = eallocmemimage(rectsubpt(screen->r, screen->r.min), screen->chan);
+		fbr = screenfb->r;
+	}else{
+		if(memimageinit() != 0)
+			sysfatal("memimageinit: %r");
+		fbr = Rect(0,0,fbw,fbh);
+	}
+
+	fbctl = newfbctl(fbr, zfmt, lazyclear);
+
+	viewport(fbr);
 	projection(-1.0/vec3len(subpt3(camera, center)));
 	lookat(camera, center, up);
 	mulm3(view, proj);
 	light = normvec3(subpt3(light, center));
 
+	if(benchmode){
+		bench(mdlpath, nframes);
+		threadexitsall(nil);
+	}
+	if(out != nil){
+		headless(s, out, nframes, dt*1e6);
+		quit();
+	}
+
 	drawc = chancreate(sizeof(void*), 1);
+	stopc = chancreate(sizeof(void*), 0);
 	display->locking = 1;
 	unlockdisplay(display);
 
@@ -0,0 +1,309 @@
+#include <u.h>
+#include <libc.h>
+#include <thread.h>
+#include <draw.h>
+#include <memdraw.h>
+#include <mouse.h>
+#include <keyboard.h>
+#include <geometry.h>
+#include <mp.h>
+#include <libsec.h>
+#include "libobj/obj.h"
+#include "dat.h"
+#include "fns.h"
+
+/*
+ * mesh cache file layout, in host byte order:
+ *	magic[8] order[4] sha1[20] nverts[4] ntris[4]
+ *	pos[nverts*3] norm[nverts*3] uv[nverts*3] tris[ntris*3]
+ * order holds MCORDER, so a cache made on a host of
+ * the other endianness is seen as stale and rebuilt.
+ */
+enum {
+	MCMAGICLEN	= 8,
+	MCORDER		= 0x01020304,
+	MCHDRSIZE	= MCMAGICLEN+4+SHA1dlen+4+4,
+};
+static char mcmagic[MCMAGICLEN] = "tmesh01\n";
+
+typedef struct Vkey Vkey;
+struct Vkey
+{
+	int v, vt, vn;
+};
+
+static Point3
+objpos(OBJ *obj, int i)
+{
+	OBJVertex *v;
+
+	v = &obj->vertdata[OBJVGeometric].verts[i];
+	return Pt3(v->x, v->y, v->z, 1);
+}
+
+/*
+ * flatten the faces of an OBJ into a triangle mesh. polygons are
+ * triangulated as fans. every unique position/texture/normal
+ * combination becomes a single mesh vertex, so shared vertices only
+ * go through the vertex shader once. faces without normals get a
+ * face normal of their own per triangle.
+ */
+Mesh *
+compilemesh(OBJ *obj)
+{
+	Mesh *m;
+	OBJObject *o;
+	OBJElem *e;
+	OBJIndexArray *vidx, *tidx, *nidx;
+	OBJVertex *tv, *nv;
+	Vkey *keys, k;
+	Point3 n, p[3];
+	ulong *ht, nht, h, refs, ntris;
+	int i, j, c, corner[3];
+
+	ntris = 0;
+	for(i = 0; i < nelem(obj->objtab); i++)
+		for(o = obj->objtab[i]; o != nil; o = o->next)
+			for(e = o->child; e != nil; e = e->next)
+				if(e->type == OBJEFace && e->indextab[OBJVGeometric].nindex >= 3)
+					ntris += e->indextab[OBJVGeometric].nindex - 2;
+
+	/* worst case, every corner is a vertex of its own */
+	refs = 3*ntris;
+	m = emalloc(sizeof *m);
+	memset(m, 0, sizeof *m);
+	m->pos = emalloc(refs*3*sizeof(*m->pos));
+	m->norm = emalloc(refs*3*sizeof(*m->norm));
+	m->uv = emalloc(refs*3*sizeof(*m->uv));
+	m->tris = emalloc(refs*sizeof(*m->tris));
+	keys = emalloc(refs*sizeof(*keys));
+	for(nht = 1; nht < 2*refs; nht <<= 1)
+		;
+	ht = emalloc(nht*sizeof(*ht));
+	memset(ht, 0, nht*sizeof(*ht));
+
+	for(i = 0; i < nelem(obj->objtab); i++)
+	for(o = obj->objtab[i]; o != nil; o = o->next)
+	for(e = o->child; e != nil; e = e->next){
+		vidx = &e->indextab[OBJVGeometric];
+		tidx = &e->indextab[OBJVTexture];
+		nidx = &e->indextab[OBJVNormal];
+		if(e->type != OBJEFace || vidx->nindex < 3)
+			continue;
+
+		for(j = 1; j+1 < vidx->nindex; j++){
+			corner[0] = 0;
+			corner[1] = j;
+			corner[2] = j+1;
+			if(nidx->nindex != vidx->nindex){
+				for(c = 0; c < 3; c++)
+					p[c] = objpos(obj, vidx->indices[corner[c]]);
+				n = normvec3(crossvec3(subpt3(p[2], p[0]), subpt3(p[1], p[0])));
+				n = mulpt3(n, -1);
+			}
+			for(c = 0; c < 3; c++){
+				k.v = vidx->indices[corner[c]];
+				k.vt = tidx->nindex == vidx->nindex? tidx->indices[corner[c]]: -1;
+				k.vn = nidx->nindex == vidx->nindex? nidx->indices[corner[c]]: -1 - m->ntris;
+
+				for(h = (k.v*2654435761UL ^ k.vt*40503UL ^ k.vn*2246822519UL) & nht-1; ht[h] != 0; h = h+1 & nht-1)
+					if(memcmp(&keys[ht[h]-1], &k, sizeof k) == 0)
+						break;
+				if(ht[h] == 0){
+					keys[m->nverts] = k;
+					p[c] = objpos(obj, k.v);
+					m->pos[3*m->nverts+0] = p[c].x;
+					m->pos[3*m->nverts+1] = p[c].y;
+					m->pos[3*m->nverts+2] = p[c].z;
+					if(k.vn >= 0){
+						nv = &obj->vertdata[OBJVNormal].verts[k.vn];
+						n = normvec3(Vec3(nv->i, nv->j, nv->k));
+					}
+					m->norm[3*m->nverts+0] = n.x;
+					m->norm[3*m->nverts+1] = n.y;
+					m->norm[3*m->nverts+2] = n.z;
+					if(k.vt >= 0){
+						tv = &obj->vertdata[OBJVTexture].verts[k.vt];
+						m->uv[3*m->nverts+0] = tv->u;
+						m->uv[3*m->nverts+1] = tv->v;
+						m->uv[3*m->nverts+2] = 1;
+					}else
+						m->uv[3*m->nverts+0] = m->uv[3*m->nverts+1] = m->uv[3*m->nverts+2] = 0;
+					ht[h] = ++m->nverts;
+				}
+				m->tris[3*m->ntris+c] = ht[h]-1;
+			}
+			m->ntris++;
+		}
+	}
+	free(ht);
+	free(keys);
+
+	m->pos = erealloc(m->pos, m->nverts*3*sizeof(*m->pos));
+	m->norm = erealloc(m->norm, m->nverts*3*sizeof(*m->norm));
+	m->uv = erealloc(m->uv, m->nverts*3*sizeof(*m->uv));
+	return m;
+}
+
+static vlong
+meshsize(vlong nverts, vlong ntris)
+{
+	return MCHDRSIZE + 3*3*nverts*sizeof(float) + 3*ntris*sizeof(u32int);
+}
+
+static int
+hashfile(char *path, uchar *digest)
+{
+	DigestState *ds;
+	uchar buf[8192];
+	long n;
+	int fd;
+
+	if((fd = open(path, OREAD)) < 0)
+		return -1;
+	ds = nil;
+	while((n = read(fd, buf, sizeof buf)) > 0)
+		ds = sha1(buf, n, nil, ds);
+	close(fd);
+	if(n < 0){
+		free(ds);
+		return -1;
+	}
+	sha1(nil, 0, digest, ds);
+	return 0;
+}
+
+/*
+ * the cache is read in one go into a single block, and the
+ * mesh arrays point straight into it: nothing gets parsed.
+ */
+static Mesh *
+readmeshcache(char *path, uchar *digest)
+{
+	Mesh *m;
+	Dir *d;
+	uchar *buf, *p;
+	u32int order, nverts, ntris, i;
+	vlong len;
+	int fd;
+
+	if((fd = open(path, OREAD)) < 0)
+		return nil;
+	if((d = dirfstat(fd)) == nil){
+		close(fd);
+		return nil;
+	}
+	len = d->length;
+	free(d);
+	if(len < MCHDRSIZE){
+		close(fd);
+		return nil;
+	}
+	buf = emalloc(len);
+	if(readn(fd, buf, len) != len){
+		close(fd);
+		free(buf);
+		return nil;
+	}
+	close(fd);
+
+	p = buf;
+	if(memcmp(p, mcmagic, MCMAGICLEN) != 0)
+		goto stale;
+	p += MCMAGICLEN;
+	memmove(&order, p, 4), p += 4;
+	if(order != MCORDER || memcmp(p, digest, SHA1dlen) != 0)
+		goto stale;
+	p += SHA1dlen;
+	memmove(&nverts, p, 4), p += 4;
+	memmove(&ntris, p, 4), p += 4;
+	if(len != meshsize(nverts, ntris))
+		goto stale;
+
+	m = emalloc(sizeof *m);
+	memset(m, 0, sizeof *m);
+	m->nverts = nverts;
+	m->ntris = ntris;
+	m->pos = (float*)p, p += 3*nverts*sizeof(float);
+	m->norm = (float*)p, p += 3*nverts*sizeof(float);
+	m->uv = (float*)p, p += 3*nverts*sizeof(float);
+	m->tris = (u32int*)p;
+	for(i = 0; i < 3*ntris; i++)
+		if(m->tris[i] >= nverts){
+			free(m);
+			goto stale;
+		}
+	return m;
+stale:
+	free(buf);
+	return nil;
+}
+
+static int
+writemeshcache(char *path, Mesh *m, uchar *digest)
+{
+	uchar hdr[MCHDRSIZE], *p;
+	u32int v;
+	long n;
+	int fd;
+
+	p = hdr;
+	memmove(p, mcmagic, MCMAGICLEN), p += MCMAGICLEN;
+	v = MCORDER, memmove(p, &v, 4), p += 4;
+	memmove(p, digest, SHA1dlen), p += SHA1dlen;
+	v = m->nverts, memmove(p, &v, 4), p += 4;
+	v = m->ntris, memmove(p, &v, 4), p += 4;
+
+	if((fd = create(path, OWRITE, 0644)) < 0)
+		return -1;
+	n = 3*m->nverts*sizeof(float);
+	if(write(fd, hdr, sizeof hdr) != sizeof hdr
+	|| write(fd, m->pos, n) != n
+	|| write(fd, m->norm, n) != n
+	|| write(fd, m->uv, n) != n
+	|| write(fd, m->tris, 3*m->ntris*sizeof(u32int)) != 3*m->ntris*sizeof(u32int)){
+		close(fd);
+		remove(path);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+/*
+ * load the mesh for an OBJ file. the compiled mesh is cached
+ * next to it, with the .obj suffix replaced by .mesh, and
+ * reused for as long as the hash of the OBJ matches.
+ */
+Mesh *
+loadmesh(char *objpath)
+{
+	Mesh *m;
+	OBJ *obj;
+	uchar digest[SHA1dlen];
+	char *cpath, *p;
+
+	if(hashfile(objpath, digest) < 0)
+		return nil;
+	cpath = emalloc(strlen(objpath)+5+1);
+	strcpy(cpath, objpath);
+	if((p = strrchr(cpath, '.')) != nil && strcmp(p, ".obj") == 0)
+		*p = 0;
+	strcat(cpath, ".mesh");
+
+	if((m = readmeshcache(cpath, digest)) != nil){
+		free(cpath);
+		return m;
+	}
+
+	if((obj = objparse(objpath)) == nil){
+		free(cpath);
+		return nil;
+	}
+	m = compilemesh(obj);
+	objfree(obj);
+	if(writemeshcache(cpath, m, digest) < 0)
+		fprint(2, "warning: couldn't write %s: %r\n", cpath);
+	free(cpath);
+	return m;
+}
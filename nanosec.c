@@ -48,7 +48,7 @@ nanosec(void)
 	static uvlong fasthz, xstart;
 	char buf[13], path[128];
 	ulong w;
-	uvlong x, div;
+	uvlong x;
 	int fd;
 	Res r;
 
@@ -102,8 +102,6 @@ Wallclock:
 	cycles(&x);
 	x -= xstart;
 
-	/* this is ugly */
-	for(div = 1000000000ULL; x < 0x1999999999999999ULL && div > 1 ; div /= 10ULL, x *= 10ULL);
-
-	return x / (fasthz / div);
+	/* split so neither product overflows, as long as fasthz < 18GHz */
+	return x/fasthz*1000000000ULL + x%fasthz*1000000000ULL/fasthz;
 }
@@ -0,0 +1,425 @@
+#include <u.h>
+#include <libc.h>
+#include <bio.h>
+#include <flate.h>
+#include <thread.h>
+#include <draw.h>
+#include <memdraw.h>
+#include <mouse.h>
+#include <keyboard.h>
+#include <geometry.h>
+#include "libobj/obj.h"
+#include "dat.h"
+#include "fns.h"
+
+/* color types */
+enum {
+	PNGGray = 0,
+	PNGRGB = 2,
+	PNGPal = 3,
+	PNGGrayA = 4,
+	PNGRGBA = 6,
+};
+
+/* filter types */
+enum {
+	FNone,
+	FSub,
+	FUp,
+	FAvg,
+	FPaeth,
+};
+
+typedef struct Pngdec Pngdec;
+struct Pngdec
+{
+	Biobuf *bin;
+	long left;		/* of the current IDAT chunk */
+	Texture *t;
+
+	int w, h;
+	int depth;
+	int ctype;
+	int nchan;
+	int interlaced;
+	ulong pal[256];		/* as texels */
+	uchar trns[256];	/* palette alphas */
+	int ntrns;
+	int key[3];		/* transparent color, -1 if none */
+
+	int pass;		/* of adam7, or 0 if not interlaced */
+	int px, py, pdx, pdy;	/* pass origin and steps */
+	int pw, ph;		/* pass dimensions */
+	int row;		/* within the pass */
+	int bpp;		/* bytes per pixel, at least 1 */
+	int bpl;		/* bytes per line */
+	uchar *cur, *prev;	/* filter byte + line */
+	int pos;
+	int done;
+};
+
+/* x, y, dx, dy of every adam7 pass */
+static int adam7[7][4] = {
+	0, 0, 8, 8,
+	4, 0, 8, 8,
+	0, 4, 4, 8,
+	2, 0, 4, 4,
+	0, 2, 2, 4,
+	1, 0, 2, 2,
+	0, 1, 1, 2,
+};
+
+static ulong
+get32(uchar *p)
+{
+	return (ulong)p[0]<<24 | p[1]<<16 | p[2]<<8 | p[3];
+}
+
+/*
+ * set up the next pass with pixels in it, if any.
+ */
+static void
+nextpass(Pngdec *d)
+{
+	for(;;){
+		if(!d->interlaced){
+			if(d->pass++ > 0)
+				break;
+			d->px = d->py = 0;
+			d->pdx = d->pdy = 1;
+		}else{
+			if(d->pass >= nelem(adam7))
+				break;
+			d->px = adam7[d->pass][0];
+			d->py = adam7[d->pass][1];
+			d->pdx = adam7[d->pass][2];
+			d->pdy = adam7[d->pass][3];
+			d->pass++;
+		}
+		d->pw = (d->w - d->px + d->pdx-1)/d->pdx;
+		d->ph = (d->h - d->py + d->pdy-1)/d->pdy;
+		if(d->pw > 0 && d->ph > 0){
+			d->bpl = (d->pw*d->nchan*d->depth + 7)/8;
+			memset(d->prev, 0, d->bpl+1);
+			d->row = 0;
+			d->pos = 0;
+			return;
+		}
+	}
+	d->done = 1;
+}
+
+static int
+paeth(int a, int b, int c)
+{
+	int p, pa, pb, pc;
+
+	p = a + b - c;
+	pa = abs(p - a);
+	pb = abs(p - b);
+	pc = abs(p - c);
+	if(pa <= pb && pa <= pc)
+		return a;
+	return pb <= pc? b: c;
+}
+
+static int
+unfilter(Pngdec *d)
+{
+	uchar *l, *u;
+	int i, a, c;
+
+	l = d->cur+1;
+	u = d->prev+1;
+	switch(d->cur[0]){
+	case FNone:
+		break;
+	case FSub:
+		for(i = d->bpp; i < d->bpl; i++)
+			l[i] += l[i - d->bpp];
+		break;
+	case FUp:
+		for(i = 0; i < d->bpl; i++)
+			l[i] += u[i];
+		break;
+	case FAvg:
+		for(i = 0; i < d->bpl; i++){
+			a = i >= d->bpp? l[i - d->bpp]: 0;
+			l[i] += (a + u[i])/2;
+		}
+		break;
+	case FPaeth:
+		for(i = 0; i < d->bpl; i++){
+			a = i >= d->bpp? l[i - d->bpp]: 0;
+			c = i >= d->bpp? u[i - d->bpp]: 0;
+			l[i] += paeth(a, u[i], c);
+		}
+		break;
+	default:
+		werrstr("png: bad filter type %d", d->cur[0]);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * sample n of the line, scaled to 8 bits, or kept as is for
+ * palette indices. 16-bit samples keep their high byte, but
+ * the full value goes into *raw to check against tRNS.
+ */
+static int
+sample(Pngdec *d, uchar *l, int n, int *raw)
+{
+	int v, shift;
+
+	switch(d->depth){
+	case 16:
+		*raw = l[2*n]<<8 | l[2*n+1];
+		return l[2*n];
+	case 8:
+		*raw = l[n];
+		return l[n];
+	}
+	shift = 8 - d->depth - n*d->depth%8;
+	v = l[n*d->depth/8] >> shift & (1<<d->depth)-1;
+	*raw = v;
+	if(d->ctype == PNGPal)
+		return v;
+	return v*255/((1<<d->depth)-1);
+}
+
+static void
+emitline(Pngdec *d)
+{
+	uchar *l;
+	ulong c;
+	int i, x, y, s[4], raw[4];
+
+	l = d->cur+1;
+	y = d->py + d->row*d->pdy;
+	for(i = 0, x = d->px; i < d->pw; i++, x += d->pdx){
+		switch(d->ctype){
+		case PNGGray:
+			s[0] = sample(d, l, i, &raw[0]);
+			c = premul(s[0], s[0], s[0], raw[0] == d->key[0]? 0: 0xFF);
+			break;
+		case PNGRGB:
+			s[0] = sample(d, l, 3*i, &raw[0]);
+			s[1] = sample(d, l, 3*i+1, &raw[1]);
+			s[2] = sample(d, l, 3*i+2, &raw[2]);
+			c = raw[0] == d->key[0] && raw[1] == d->key[1] && raw[2] == d->key[2]?
+				0: premul(s[0], s[1], s[2], 0xFF);
+			break;
+		case PNGPal:
+			c = d->pal[sample(d, l, i, &raw[0])];
+			break;
+		case PNGGrayA:
+			s[0] = sample(d, l, 2*i, &raw[0]);
+			s[1] = sample(d, l, 2*i+1, &raw[1]);
+			c = premul(s[0], s[0], s[0], s[1]);
+			break;
+		default:
+			s[0] = sample(d, l, 4*i, &raw[0]);
+			s[1] = sample(d, l, 4*i+1, &raw[1]);
+			s[2] = sample(d, l, 4*i+2, &raw[2]);
+			s[3] = sample(d, l, 4*i+3, &raw[3]);
+			c = premul(s[0], s[1], s[2], s[3]);
+			break;
+		}
+		texput(d->t, x, y, c);
+	}
+}
+
+/*
+ * inflated data comes in here a block at a time. lines get
+ * unfiltered and stored as soon as they are complete.
+ */
+static int
+pngwrite(void *a, void *buf, int n)
+{
+	Pngdec *d;
+	uchar *p, *e, *tmp;
+
+	d = a;
+	for(p = buf, e = p+n; p < e && !d->done; p++){
+		d->cur[d->pos++] = *p;
+		if(d->pos < d->bpl+1)
+			continue;
+		if(unfilter(d) < 0)
+			return -1;
+		emitline(d);
+		tmp = d->prev;
+		d->prev = d->cur;
+		d->cur = tmp;
+		d->pos = 0;
+		if(++d->row == d->ph)
+			nextpass(d);
+	}
+	return n;
+}
+
+/*
+ * feed the inflater the contents of consecutive IDAT chunks.
+ */
+static int
+pngget(void *a)
+{
+	Pngdec *d;
+	uchar buf[12];
+
+	d = a;
+	while(d->left == 0){
+		/* skip the crc and read the next chunk's header */
+		if(Bread(d->bin, buf, sizeof buf) != sizeof buf
+		|| memcmp(buf+8, "IDAT", 4) != 0)
+			return -1;
+		d->left = get32(buf+4);
+	}
+	d->left--;
+	return Bgetc(d->bin);
+}
+
+/*
+ * decode a PNG image of any color type and depth, interlaced
+ * or not, inflating its IDAT chunks as they are read.
+ */
+static Texture *
+decodepng(Biobuf *bin, int layout)
+{
+	static int inited;
+	Pngdec d;
+	uchar buf[13];
+	ulong len;
+	int i, r;
+	char type[5];
+
+	if(!inited){
+		inflateinit();
+		inited++;
+	}
+
+	memset(&d, 0, sizeof d);
+	d.bin = bin;
+	d.key[0] = d.key[1] = d.key[2] = -1;
+	if(Bread(bin, buf, 8) != 8 || memcmp(buf, "\x89PNG\r\n\x1a\n", 8) != 0){
+		werrstr("png: bad signature");
+		return nil;
+	}
+	type[4] = 0;
+	for(;;){
+		if(Bread(bin, buf, 8) != 8){
+			werrstr("png: no image data");
+			goto error;
+		}
+		len = get32(buf);
+		memmove(type, buf+4, 4);
+
+		if(strcmp(type, "IHDR") == 0){
+			if(len != 13 || Bread(bin, buf, 13) != 13){
+				werrstr("png: bad IHDR");
+				goto error;
+			}
+			d.w = get32(buf);
+			d.h = get32(buf+4);
+			d.depth = buf[8];
+			d.ctype = buf[9];
+			d.interlaced = buf[12];
+			switch(d.ctype){
+			case PNGGray: d.nchan = 1; break;
+			case PNGRGB: d.nchan = 3; break;
+			case PNGPal: d.nchan = 1; break;
+			case PNGGrayA: d.nchan = 2; break;
+			case PNGRGBA: d.nchan = 4; break;
+			default:
+				werrstr("png: bad color type %d", d.ctype);
+				goto error;
+			}
+			if(d.w == 0 || d.h == 0 || d.w > 1<<14 || d.h > 1<<14
+			|| d.depth == 0 || d.depth > 16 || 16 % d.depth != 0
+			|| (d.ctype != PNGGray && d.ctype != PNGPal && d.depth < 8)
+			|| (d.ctype == PNGPal && d.depth > 8)
+			|| buf[10] != 0 || buf[11] != 0 || d.interlaced > 1){
+				werrstr("png: unsupported format");
+				goto error;
+			}
+			d.bpp = max(1, d.nchan*d.depth/8);
+		}else if(strcmp(type, "PLTE") == 0){
+			if(len % 3 != 0 || len > 3*256){
+				werrstr("png: bad PLTE");
+				goto error;
+			}
+			for(i = 0; i < len/3; i++){
+				if(Bread(bin, buf, 3) != 3){
+					werrstr("png: short PLTE");
+					goto error;
+				}
+				d.pal[i] = premul(buf[0], buf[1], buf[2], 0xFF);
+			}
+		}else if(strcmp(type, "tRNS") == 0){
+			if(d.ctype == PNGPal && len <= 256){
+				if(Bread(bin, d.trns, len) != len){
+					werrstr("png: short tRNS");
+					goto error;
+				}
+				d.ntrns = len;
+			}else if((d.ctype == PNGGray && len == 2) || (d.ctype == PNGRGB && len == 6)){
+				for(i = 0; i < len/2; i++){
+					if(Bread(bin, buf, 2) != 2){
+						werrstr("png: short tRNS");
+						goto error;
+					}
+					d.key[i] = buf[0]<<8 | buf[1];
+				}
+			}else
+				Bseek(bin, len, 1);
+		}else if(strcmp(type, "IDAT") == 0){
+			if(d.nchan == 0){
+				werrstr("png: IDAT before IHDR");
+				goto error;
+			}
+			break;
+		}else
+			Bseek(bin, len, 1);
+		/* crc */
+		Bseek(bin, 4, 1);
+	}
+
+	/* fold the palette alphas in */
+	for(i = 0; i < d.ntrns; i++)
+		d.pal[i] = premul(d.pal[i]>>24 & 0xFF, d.pal[i]>>16 & 0xFF, d.pal[i]>>8 & 0xFF, d.trns[i]);
+
+	d.t = alloctexture(d.w, d.h, layout);
+	d.cur = emalloc((d.w*d.nchan*d.depth + 7)/8 + 1);
+	d.prev = emalloc((d.w*d.nchan*d.depth + 7)/8 + 1);
+	nextpass(&d);
+	d.left = len;
+	if((r = inflatezlib(&d, pngwrite, &d, pngget)) != FlateOk){
+		werrstr("png: %s", flateerr(r));
+		goto error;
+	}
+	if(!d.done){
+		werrstr("png: short image data");
+		goto error;
+	}
+	free(d.cur);
+	free(d.prev);
+	return d.t;
+error:
+	free(d.cur);
+	free(d.prev);
+	freetexture(d.t);
+	return nil;
+}
+
+Texture *
+readpng(char *path, int layout)
+{
+	Texture *t;
+	Biobuf *bin;
+
+	if((bin = Bopen(path, OREAD)) == nil)
+		return nil;
+	t = decodepng(bin, layout);
+	Bterm(bin);
+	return t;
+}
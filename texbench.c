@@ -0,0 +1,94 @@
+#include <u.h>
+#include <libc.h>
+#include <thread.h>
+#include <draw.h>
+#include <memdraw.h>
+#include <mouse.h>
+#include <keyboard.h>
+#include <geometry.h>
+#include "libobj/obj.h"
+#include "dat.h"
+#include "fns.h"
+
+/*
+ * texture fetch throughput, for every layout and filter,
+ * walking the full image along its rows and along its
+ * columns, one sample per texel.
+ */
+
+enum {
+	Rows,
+	Cols,
+};
+
+char *layoutnames[] = { "linear", "blocked" };
+char *filternames[] = { "nearest", "bilinear" };
+char *walknames[] = { "rows", "cols" };
+int niter = 4;
+
+static ulong
+walk(Texture *t, int how, uvlong *ns)
+{
+	Point2 uv;
+	uvlong t0;
+	ulong sum;
+	int i, j, w, h, n;
+
+	w = t->levels[0].w;
+	h = t->levels[0].h;
+	sum = 0;
+	t0 = nanosec();
+	for(n = 0; n < niter; n++)
+	for(i = 0; i < (how == Rows? h: w); i++)
+	for(j = 0; j < (how == Rows? w: h); j++){
+		if(how == Rows)
+			uv = Pt2((j+0.5)/w, 1 - (i+0.5)/h, 1);
+		else
+			uv = Pt2((i+0.5)/w, 1 - (j+0.5)/h, 1);
+		sum += texsample(t, uv, 0);
+	}
+	*ns = nanosec() - t0;
+	return sum;
+}
+
+static void
+usage(void)
+{
+	fprint(2, "usage: %s [-n iterations] texfile...\n", argv0);
+	exits("usage");
+}
+
+void
+threadmain(int argc, char *argv[])
+{
+	Texture *t;
+	uvlong ns;
+	ulong sum;
+	int i, l, f, how;
+
+	ARGBEGIN{
+	case 'n':
+		niter = strtoul(EARGF(usage()), nil, 10);
+		break;
+	default: usage();
+	}ARGEND;
+	if(argc == 0 || niter < 1)
+		usage();
+
+	for(i = 0; i < argc; i++)
+		for(l = 0; l < nelem(layoutnames); l++){
+			if((t = readtexture(argv[i], l)) == nil)
+				sysfatal("readtexture: %r");
+			for(f = 0; f < nelem(filternames); f++){
+				t->filter = f;
+				for(how = 0; how < nelem(walknames); how++){
+					sum = walk(t, how, &ns);
+					print("%s %s %s %s %.1f Mtexel/s %08lux\n",
+						argv[i], layoutnames[l], filternames[f], walknames[how],
+						ns == 0? 0: 1e3*niter*t->levels[0].w*t->levels[0].h/ns, sum);
+				}
+			}
+			freetexture(t);
+		}
+	threadexitsall(nil);
+}
@@ -0,0 +1,283 @@
+#include <u.h>
+#include <libc.h>
+#include <thread.h>
+#include <draw.h>
+#include <memdraw.h>
+#include <mouse.h>
+#include <keyboard.h>
+#include <geometry.h>
+#include "libobj/obj.h"
+#include "dat.h"
+#include "fns.h"
+
+#define LN2	0.69314718055994530942
+
+/*
+ * allocate the storage for a level in the texture's layout.
+ * blocked levels get their edge blocks padded, but the padding
+ * is never addressed.
+ */
+static void
+alloclevel(Texture *t, Texlevel *l, int w, int h)
+{
+	long n;
+
+	l->w = w;
+	l->h = h;
+	l->bw = (w + TEXBLK-1)/TEXBLK;
+	if(t->layout == TBlocked)
+		n = l->bw*((h + TEXBLK-1)/TEXBLK)*TEXBLK*TEXBLK;
+	else
+		n = w*h;
+	l->data = emalloc(n*sizeof(*l->data));
+	memset(l->data, 0, n*sizeof(*l->data));
+}
+
+static long
+texidx(Texture *t, Texlevel *l, int x, int y)
+{
+	uint bx, by;
+
+	if(t->layout == TBlocked){
+		bx = x, by = y;
+		return ((by/TEXBLK*l->bw + bx/TEXBLK)*TEXBLK + by%TEXBLK)*TEXBLK + bx%TEXBLK;
+	}
+	return y*l->w + x;
+}
+
+/*
+ * allocate a texture with room for the full image, in the given
+ * layout. it's up to the caller to fill it in with texput and
+ * then build the rest of the chain with mkmips.
+ */
+Texture *
+alloctexture(int w, int h, int layout)
+{
+	Texture *t;
+	int n, lw, lh;
+
+	t = emalloc(sizeof *t);
+	memset(t, 0, sizeof *t);
+	for(n = 1, lw = w, lh = h; lw > 1 || lh > 1; n++){
+		lw = lw > 1? lw/2: 1;
+		lh = lh > 1? lh/2: 1;
+	}
+	t->levels = emalloc(n*sizeof(*t->levels));
+	memset(t->levels, 0, n*sizeof(*t->levels));
+	t->nlevels = n;
+	t->layout = layout;
+	t->filter = TNearest;
+	t->wrap = TWrap;
+	alloclevel(t, &t->levels[0], w, h);
+	return t;
+}
+
+void
+texput(Texture *t, int x, int y, ulong c)
+{
+	Texlevel *l;
+
+	l = &t->levels[0];
+	l->data[texidx(t, l, x, y)] = c;
+}
+
+/*
+ * box filter every level down to half the size of the one above.
+ * odd rows and columns get folded into the last texel, which then
+ * averages up to 3x3 texels.
+ */
+void
+mkmips(Texture *t)
+{
+	Texlevel *src, *dst;
+	ulong c, r, acc[4];
+	int n, x, y, i, sx, sy, x0, x1, y0, y1, cnt;
+
+	for(n = 1; n < t->nlevels; n++){
+		src = &t->levels[n-1];
+		dst = &t->levels[n];
+		alloclevel(t, dst, src->w > 1? src->w/2: 1, src->h > 1? src->h/2: 1);
+		for(y = 0; y < dst->h; y++){
+			y0 = 2*y;
+			y1 = y == dst->h-1? src->h-1: 2*y+1;
+			for(x = 0; x < dst->w; x++){
+				x0 = 2*x;
+				x1 = x == dst->w-1? src->w-1: 2*x+1;
+				acc[0] = acc[1] = acc[2] = acc[3] = 0;
+				for(sy = y0; sy <= y1; sy++)
+				for(sx = x0; sx <= x1; sx++){
+					c = src->data[texidx(t, src, sx, sy)];
+					for(i = 0; i < 4; i++)
+						acc[i] += c>>8*i & 0xFF;
+				}
+				cnt = (x1-x0+1)*(y1-y0+1);
+				r = 0;
+				for(i = 0; i < 4; i++)
+					r |= (acc[i] + cnt/2)/cnt << 8*i;
+				dst->data[texidx(t, dst, x, y)] = r;
+			}
+		}
+	}
+}
+
+/*
+ * pack a straight-alpha color into a premultiplied texel.
+ */
+ulong
+premul(int r, int g, int b, int a)
+{
+	r = (r*a + 127)/255;
+	g = (g*a + 127)/255;
+	b = (b*a + 127)/255;
+	return (ulong)r<<24 | g<<16 | b<<8 | a;
+}
+
+/*
+ * decode a TGA or PNG file straight into a texture, picking the
+ * decoder by the file's extension.
+ */
+Texture *
+readtexture(char *path, int layout)
+{
+	Texture *t;
+	char *p;
+
+	if((p = strrchr(path, '/')) == nil)
+		p = path;
+	if((p = strrchr(p, '.')) == nil){
+		werrstr("unknown image file");
+		return nil;
+	}
+	p++;
+	if(strcmp(p, "tga") != 0 && strcmp(p, "png") != 0){
+		werrstr("unknown image file");
+		return nil;
+	}
+	t = strcmp(p, "tga") == 0? readtga(path, layout): readpng(path, layout);
+	if(t == nil)
+		return nil;
+	mkmips(t);
+	return t;
+}
+
+void
+freetexture(Texture *t)
+{
+	int i;
+
+	if(t == nil)
+		return;
+	for(i = 0; i < t->nlevels; i++)
+		free(t->levels[i].data);
+	free(t->levels);
+	free(t);
+}
+
+static int
+wrapcoord(int x, int n, int wrap)
+{
+	switch(wrap){
+	case TClamp:
+		return x < 0? 0: x >= n? n-1: x;
+	default:
+		x %= n;
+		return x < 0? x+n: x;
+	}
+}
+
+static ulong
+texel(Texture *t, Texlevel *l, int x, int y)
+{
+	x = wrapcoord(x, l->w, t->wrap);
+	y = wrapcoord(y, l->h, t->wrap);
+	return l->data[texidx(t, l, x, y)];
+}
+
+/*
+ * weights are in 1/256ths, so the sums fit an int.
+ */
+static ulong
+bilerp(ulong c00, ulong c10, ulong c01, ulong c11, int fx, int fy)
+{
+	ulong r;
+	int i, a, b;
+
+	r = 0;
+	for(i = 0; i < 32; i += 8){
+		a = (c00>>i & 0xFF)*(256-fx) + (c10>>i & 0xFF)*fx;
+		b = (c01>>i & 0xFF)*(256-fx) + (c11>>i & 0xFF)*fx;
+		r |= (ulong)((a*(256-fy) + b*fy + (1<<15)) >> 16) << i;
+	}
+	return r;
+}
+
+static ulong
+nearest(Texture *t, Texlevel *l, Point2 uv)
+{
+	return texel(t, l, floor(uv.x*l->w), floor((1 - uv.y)*l->h));
+}
+
+static ulong
+bilinear(Texture *t, Texlevel *l, Point2 uv)
+{
+	double x, y;
+	int x0, y0, fx, fy;
+
+	/* texel centers lie at half-integer coords */
+	x = uv.x*l->w - 0.5;
+	y = (1 - uv.y)*l->h - 0.5;
+	x0 = floor(x);
+	y0 = floor(y);
+	fx = (x - x0)*256;
+	fy = (y - y0)*256;
+	return bilerp(
+		texel(t, l, x0, y0), texel(t, l, x0+1, y0),
+		texel(t, l, x0, y0+1), texel(t, l, x0+1, y0+1),
+		fx, fy);
+}
+
+/*
+ * level of detail for a footprint with the given uv derivatives:
+ * log2 of the texels covered along the longest screen axis.
+ */
+double
+texlod(Texture *t, Point2 dx, Point2 dy)
+{
+	double w, h, ρx, ρy;
+
+	w = t->levels[0].w;
+	h = t->levels[0].h;
+	ρx = dx.x*w*dx.x*w + dx.y*h*dx.y*h;
+	ρy = dy.x*w*dy.x*w + dy.y*h*dy.y*h;
+	ρx = fmax(ρx, ρy);
+	if(ρx <= 1)
+		return 0;
+	return 0.5*log(ρx)/LN2;
+}
+
+/*
+ * sample the texture at uv, with the origin at the bottom-left
+ * corner as in OBJ files. lod only matters to trilinear filtering.
+ * returns a 0xRRGGBBAA color.
+ */
+ulong
+texsample(Texture *t, Point2 uv, double lod)
+{
+	int l, f;
+
+	switch(t->filter){
+	case TTrilinear:
+		if(lod >= t->nlevels-1)
+			return bilinear(t, &t->levels[t->nlevels-1], uv);
+		l = lod;
+		f = (lod - l)*256;
+		return bilerp(
+			bilinear(t, &t->levels[l], uv), 0,
+			bilinear(t, &t->levels[l+1], uv), 0,
+			0, f);
+	case TBilinear:
+		return bilinear(t, &t->levels[0], uv);
+	default:
+		return nearest(t, &t->levels[0], uv);
+	}
+}
@@ -0,0 +1,228 @@
+#include <u.h>
+#include <libc.h>
+#include <bio.h>
+#include <thread.h>
+#include <draw.h>
+#include <memdraw.h>
+#include <mouse.h>
+#include <keyboard.h>
+#include <geometry.h>
+#include "libobj/obj.h"
+#include "dat.h"
+#include "fns.h"
+
+/* image types */
+enum {
+	TGACmap = 1,
+	TGATrue,
+	TGAGray,
+	TGARLE = 8,
+};
+
+/* descriptor bits */
+enum {
+	TGAAlphabits = 0x0F,
+	TGARight = 0x10,	/* origin at the right */
+	TGATop = 0x20,		/* origin at the top */
+};
+
+typedef struct Tgahdr Tgahdr;
+struct Tgahdr
+{
+	int idlen;
+	int cmaptype;
+	int type;
+	int cmapfirst;
+	int cmaplen;
+	int cmapbpp;
+	int w, h;
+	int bpp;
+	int desc;
+};
+
+static int
+get16(uchar *p)
+{
+	return p[0] | p[1]<<8;
+}
+
+/*
+ * read a raw pixel value, little-endian, into v. returns -1 on
+ * eof. 32-bit values take all of v, so it can't double as the
+ * error.
+ */
+static int
+getpix(Biobuf *bin, int bpp, ulong *v)
+{
+	uchar buf[4];
+	int n;
+
+	n = (bpp+7)/8;
+	if(Bread(bin, buf, n) != n)
+		return -1;
+	switch(n){
+	case 1: *v = buf[0]; break;
+	case 2: *v = get16(buf); break;
+	case 3: *v = buf[0] | buf[1]<<8 | buf[2]<<16; break;
+	default: *v = buf[0] | buf[1]<<8 | buf[2]<<16 | (ulong)buf[3]<<24; break;
+	}
+	return 0;
+}
+
+/*
+ * turn a raw true-color or gray pixel into a texel.
+ */
+static ulong
+tgacolor(ulong v, int bpp, int gray, int alpha)
+{
+	int r, g, b, a;
+
+	if(gray){
+		a = bpp == 16 && alpha? v>>8 & 0xFF: 0xFF;
+		return premul(v & 0xFF, v & 0xFF, v & 0xFF, a);
+	}
+	switch(bpp){
+	case 15:
+	case 16:
+		r = (v>>10 & 0x1F)*255/31;
+		g = (v>>5 & 0x1F)*255/31;
+		b = (v & 0x1F)*255/31;
+		a = bpp == 16 && alpha? (v>>15 & 1)*0xFF: 0xFF;
+		break;
+	default:
+		r = v>>16 & 0xFF;
+		g = v>>8 & 0xFF;
+		b = v & 0xFF;
+		a = bpp == 32 && alpha? v>>24 & 0xFF: 0xFF;
+		break;
+	}
+	return premul(r, g, b, a);
+}
+
+/*
+ * decode a TGA image, raw or run-length encoded, of any of the
+ * color-mapped, true-color and grayscale types.
+ */
+static Texture *
+decodetga(Biobuf *bin, int layout)
+{
+	Texture *t;
+	Tgahdr h;
+	uchar buf[18];
+	ulong *cmap, c, v;
+	long i, n, npix;
+	int x, y, rle, run, isrun, fresh, alpha;
+
+	if(Bread(bin, buf, sizeof buf) != sizeof buf){
+		werrstr("tga: short header");
+		return nil;
+	}
+	h.idlen = buf[0];
+	h.cmaptype = buf[1];
+	h.type = buf[2];
+	h.cmapfirst = get16(buf+3);
+	h.cmaplen = get16(buf+5);
+	h.cmapbpp = buf[7];
+	h.w = get16(buf+12);
+	h.h = get16(buf+14);
+	h.bpp = buf[16];
+	h.desc = buf[17];
+
+	rle = h.type & TGARLE;
+	switch(h.type & ~TGARLE){
+	case TGACmap:
+		if(h.cmaptype != 1 || (h.bpp != 8 && h.bpp != 16)){
+			werrstr("tga: bad color map");
+			return nil;
+		}
+		break;
+	case TGATrue:
+		if(h.bpp != 15 && h.bpp != 16 && h.bpp != 24 && h.bpp != 32){
+			werrstr("tga: unsupported depth %d", h.bpp);
+			return nil;
+		}
+		break;
+	case TGAGray:
+		if(h.bpp != 8 && h.bpp != 16){
+			werrstr("tga: unsupported depth %d", h.bpp);
+			return nil;
+		}
+		break;
+	default:
+		werrstr("tga: unsupported image type %d", h.type);
+		return nil;
+	}
+	if(h.w == 0 || h.h == 0){
+		werrstr("tga: empty image");
+		return nil;
+	}
+	alpha = (h.desc & TGAAlphabits) != 0;
+
+	Bseek(bin, h.idlen, 1);
+	cmap = nil;
+	if(h.cmaptype == 1){
+		cmap = emalloc((h.cmaplen+1)*sizeof(*cmap));
+		for(i = 0; i < h.cmaplen; i++){
+			if(getpix(bin, h.cmapbpp, &v) < 0){
+				free(cmap);
+				werrstr("tga: short color map");
+				return nil;
+			}
+			cmap[i] = tgacolor(v, h.cmapbpp, 0, alpha);
+		}
+	}
+
+	t = alloctexture(h.w, h.h, layout);
+	npix = (long)h.w*h.h;
+	run = isrun = fresh = 0;
+	c = 0;
+	for(i = 0; i < npix; i++){
+		/* a run packet repeats the one pixel after its header */
+		if(rle && run == 0){
+			if((n = Bgetc(bin)) < 0)
+				goto shortdata;
+			isrun = n & 0x80;
+			run = (n & 0x7F) + 1;
+			fresh = 1;
+		}
+		if(!rle || !isrun || fresh){
+			if(getpix(bin, h.bpp, &v) < 0)
+				goto shortdata;
+			if((h.type & ~TGARLE) == TGACmap)
+				c = v >= h.cmapfirst && v-h.cmapfirst < h.cmaplen? cmap[v-h.cmapfirst]: 0;
+			else
+				c = tgacolor(v, h.bpp, (h.type & ~TGARLE) == TGAGray, alpha);
+		}
+		fresh = 0;
+		if(rle)
+			run--;
+
+		x = i % h.w;
+		y = i / h.w;
+		if(h.desc & TGARight)
+			x = h.w-1 - x;
+		if((h.desc & TGATop) == 0)
+			y = h.h-1 - y;
+		texput(t, x, y, c);
+	}
+	free(cmap);
+	return t;
+shortdata:
+	free(cmap);
+	freetexture(t);
+	werrstr("tga: short image data");
+	return nil;
+}
+
+Texture *
+readtga(char *path, int layout)
+{
+	Texture *t;
+	Biobuf *bin;
+
+	if((bin = Bopen(path, OREAD)) == nil)
+		return nil;
+	t = decodetga(bin, layout);
+	Bterm(bin);
+	return t;
+}
@@ -0,0 +1,149 @@
+#include <u.h>
+#include <libc.h>
+#include <bio.h>
+#include <thread.h>
+#include <draw.h>
+#include <memdraw.h>
+#include <mouse.h>
+#include <keyboard.h>
+#include <geometry.h>
+#include "libobj/obj.h"
+#include "dat.h"
+#include "fns.h"
+
+/*
+ * every thread records its events into a ring of its own, so
+ * there's no locking on the way in. the ring is found through
+ * threaddata(), and only claiming one takes an atomic add. once
+ * a ring fills up, the oldest events get overwritten.
+ */
+
+enum {
+	TRACELEN	= 1<<16,	/* events per ring; a power of two */
+	MAXTRACERS	= 64,
+};
+
+typedef struct Tevent Tevent;
+struct Tevent
+{
+	char *name;
+	uvlong t;
+	int ph;		/* 'B'egin or 'E'nd */
+};
+
+typedef struct Tracer Tracer;
+struct Tracer
+{
+	char *name;		/* of the thread */
+	int id;
+	ulong head;		/* events ever recorded */
+	Tevent ev[TRACELEN];
+};
+
+int tracing;
+static Tracer *tracers[MAXTRACERS];
+static long ntracers;
+
+static Tracer *
+gettracer(void)
+{
+	Tracer **tp, *t;
+	char *name;
+	long id;
+
+	tp = (Tracer**)threaddata();
+	if(*tp != nil)
+		return *tp;
+
+	id = ainc(&ntracers)-1;
+	if(id >= MAXTRACERS)
+		return nil;
+	t = emalloc(sizeof *t);
+	memset(t, 0, sizeof *t);
+	name = threadgetname();
+	t->name = strdup(name != nil? name: "?");
+	t->id = id;
+	tracers[id] = t;
+	*tp = t;
+	return t;
+}
+
+static void
+record(char *name, int ph)
+{
+	Tracer *t;
+	Tevent *e;
+
+	if((t = gettracer()) == nil)
+		return;
+	e = &t->ev[t->head & TRACELEN-1];
+	e->name = name;
+	e->ph = ph;
+	e->t = nanosec();
+	t->head++;
+}
+
+void
+tracebegin(char *name)
+{
+	if(tracing)
+		record(name, 'B');
+}
+
+void
+traceend(char *name)
+{
+	if(tracing)
+		record(name, 'E');
+}
+
+/*
+ * write every ring out in the Chrome trace event format, which
+ * Perfetto reads too. each thread shows up as a track of its own.
+ * call it once the threads being traced are idle. tracing stops
+ * for good here, and in case a thread still gets one last event
+ * in, each ring's head is read only once and, if the ring
+ * wrapped, its oldest slot is left out.
+ */
+int
+writetrace(char *path)
+{
+	Biobuf *bout;
+	Tracer *t;
+	Tevent *e;
+	ulong i, head;
+	long n;
+	int id, depth, sep;
+
+	tracing = 0;
+	if((bout = Bopen(path, OWRITE)) == nil)
+		return -1;
+	Bprint(bout, "{\"traceEvents\":[\n");
+	sep = 0;
+	n = ntracers < MAXTRACERS? ntracers: MAXTRACERS;
+	for(id = 0; id < n; id++){
+		if((t = tracers[id]) == nil)
+			continue;
+		Bprint(bout, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+			sep++? ",\n": "", t->id, t->name);
+
+		/* a wrapped ring may begin halfway through a span */
+		head = t->head;
+		depth = 0;
+		for(i = head >= TRACELEN? head-TRACELEN+1: 0; i < head; i++){
+			e = &t->ev[i & TRACELEN-1];
+			if(e->ph == 'E' && depth-- == 0){
+				depth = 0;
+				continue;
+			}
+			if(e->ph == 'B')
+				depth++;
+			Bprint(bout, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llud.%03llud,\"pid\":1,\"tid\":%d}",
+				e->name, e->ph, e->t/1000, e->t%1000, t->id);
+		}
+	}
+	Bprint(bout, "\n]}\n");
+	if(Bterm(bout) < 0)
+		return -1;
+	return 0;
+}